@@ -12,20 +12,27 @@ URVO3DAgentComponent::URVO3DAgentComponent(const FObjectInitializer& ObjectIniti
     bAutoRegisterMovementComponent = true;
 
     MaxNeighbours = 10;
+    MinNeighbours = 1;
     NeighbourDistance = 15.f;
     TimeHorizon = 10.f;
     AgentRadius = 1.5f;
+    bPlanar = false;
+    StepMultiple = 1;
+    bPassive = false;
 
 	AvoidanceGroup.bGroup0 = true;
 	GroupsToAvoid.Packed = 0xFFFFFFFF;
 	GroupsToIgnore.Packed = 0;
 
     AvoidanceVelocity = FVector::ZeroVector;
+    StepVelocity = FVector::ZeroVector;
+    PreviousStepVelocity = FVector::ZeroVector;
     PreferredVelocity = FVector::ZeroVector;
     PreferredVelocityLockTimer = -1.f;
     GoalAdjustment = FVector::ZeroVector;
     GoalAdjustmentLockTimer = -1.f;
     bRequireGoalAdjustment = false;
+    LODTier = 0;
 }
 
 //BEGIN UActorComponent Interface
@@ -133,9 +140,10 @@ void URVO3DAgentComponent::SetSimulatorComponent(URVO3DSimulatorComponent* InSim
 
 void URVO3DAgentComponent::RegisterSimulatorDependency()
 {
+    // Movement ticks after the simulator has applied its results. In async mode that only waits for the completion of the step dispatched on the previous tick, not for the next step or its inputs.
     if (SimulatorComponent && MovementComponent)
     {
-        MovementComponent->AddTickPrerequisiteComponent(SimulatorComponent);
+        MovementComponent->PrimaryComponentTick.AddPrerequisite(SimulatorComponent, SimulatorComponent->ResultsTick);
     }
 }
 
@@ -143,7 +151,7 @@ void URVO3DAgentComponent::UnregisterSimulatorDependency()
 {
     if (SimulatorComponent && MovementComponent)
     {
-        MovementComponent->RemoveTickPrerequisiteComponent(SimulatorComponent);
+        MovementComponent->PrimaryComponentTick.RemovePrerequisite(SimulatorComponent, SimulatorComponent->ResultsTick);
     }
 }
 
@@ -252,6 +260,27 @@ void URVO3DAgentComponent::SetAvoidanceVelocity(const FVector& Velocity, bool bI
     }
 }
 
+void URVO3DAgentComponent::SetStepVelocity(const FVector& Velocity, bool bInRequireGoalAdjustment)
+{
+    PreviousStepVelocity = StepVelocity;
+    StepVelocity = Velocity;
+
+    SetAvoidanceVelocity(Velocity, bInRequireGoalAdjustment);
+}
+
+void URVO3DAgentComponent::SetSubstepVelocities(const FVector& InPreviousStepVelocity, const FVector& Velocity, bool bInRequireGoalAdjustment)
+{
+    PreviousStepVelocity = InPreviousStepVelocity;
+    StepVelocity = Velocity;
+
+    SetAvoidanceVelocity(Velocity, bInRequireGoalAdjustment);
+}
+
+void URVO3DAgentComponent::InterpolateAvoidanceVelocity(float Alpha)
+{
+    AvoidanceVelocity = FMath::Lerp(PreviousStepVelocity, StepVelocity, FMath::Clamp(Alpha, 0.f, 1.f));
+}
+
 // ~ Preferred Velocity Functions
 
 bool URVO3DAgentComponent::HasLockedPreferredVelocity() const
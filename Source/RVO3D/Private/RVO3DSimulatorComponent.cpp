@@ -1,18 +1,83 @@
 
 #include "RVO3DSimulatorComponent.h"
 #include "RVO3DAgentComponent.h"
+#include "RVO3DTaskGraphExecutor.h"
 #include "RVO.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+
+DECLARE_STATS_GROUP(TEXT("RVO3D"), STATGROUP_RVO3D, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT(TEXT("Simulation Step"), STAT_RVO3D_SimulationStep, STATGROUP_RVO3D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Isolated Agents"), STAT_RVO3D_IsolatedAgents, STATGROUP_RVO3D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Unconstrained Agents"), STAT_RVO3D_UnconstrainedAgents, STATGROUP_RVO3D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("LP3 Solved Agents"), STAT_RVO3D_LinearProgram3Agents, STATGROUP_RVO3D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("LP4 Solved Agents"), STAT_RVO3D_LinearProgram4Agents, STATGROUP_RVO3D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Budget Exceeded Agents"), STAT_RVO3D_BudgetExceededAgents, STATGROUP_RVO3D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Deferred Agents"), STAT_RVO3D_DeferredAgents, STATGROUP_RVO3D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Max Solve Age"), STAT_RVO3D_MaxSolveAge, STATGROUP_RVO3D);
+
+static RVO::AgentArchetype MakeAgentArchetype(const URVO3DAgentComponent* AgentComponent)
+{
+    RVO::AgentArchetype Archetype(
+        AgentComponent->GetNeighbourDistance(),
+        AgentComponent->GetMaxNeighbourCount(),
+        AgentComponent->GetTimeHorizon(),
+        AgentComponent->GetAgentRadius(),
+        AgentComponent->GetAgentMaxSpeed(),
+        AgentComponent->GetAvoidanceGroupMask(),
+        AgentComponent->GetGroupsToAvoidMask(),
+        AgentComponent->GetGroupsToIgnoreMask()
+    );
+
+    Archetype.minNeighbors = AgentComponent->GetMinNeighbourCount();
+    Archetype.planar = AgentComponent->IsPlanar();
+    Archetype.stepMultiple = FMath::Max(AgentComponent->GetStepMultiple(), 1);
+
+    return Archetype;
+}
 
 URVO3DSimulatorComponent::URVO3DSimulatorComponent(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
 	PrimaryComponentTick.bCanEverTick = true;
     PrimaryComponentTick.TickGroup = TG_PrePhysics;
+    ResultsTick.bCanEverTick = true;
+    ResultsTick.bStartWithTickEnabled = true;
+    ResultsTick.TickGroup = TG_PrePhysics;
 	bTickInEditor = false;
 	bAutoActivate = true;
 
     LockTimeAfterAvoid = .2f;
     LockTimeAfterGoalAdjustment = .066f;
     GoalAdjustmentAngleOffset = .125f;
+    MaxORCAPlanes = 0;
+    MaxSolverIterations = 0;
+    NeighbourSkin = 0.f;
+    bDualTreeNeighbourSearch = false;
+    bSharedPairConstraints = false;
+    bWarmStartedSolve = false;
+    bVelocityNeighbourPruning = false;
+    VelocityPruningMargin = 0.f;
+    bAdaptiveNeighbours = false;
+    AdaptiveNeighbourSmoothing = .25f;
+    AdaptiveNeighbourHeadroom = 1.5f;
+    SimulationOrigin = FIntVector::ZeroValue;
+    bAutoRebaseOrigin = false;
+    bAsyncSimulation = false;
+    bParallelSimulation = false;
+    bFixedTimeStep = false;
+    FixedTimeStep = 1.f / 30.f;
+    MaxSubsteps = 4;
+    bSimulationLOD = false;
+    SolveTimeBudget = 0.f;
+    MaxSolvedAgents = 0;
+    bUrgencyScheduling = false;
+    MaxDeferredSteps = 8;
+    DeferredAgents = 0;
+    MaxSolveAge = 0;
+    TimeAccumulator = 0.f;
+    LaunchedSteps = 0;
+    RebaseDistance = 100000.f;
 }
 
 void URVO3DSimulatorComponent::BeginPlay()
@@ -23,6 +88,20 @@ void URVO3DSimulatorComponent::BeginPlay()
     {
         Simulator = MakeShareable( new RVO::RVOSimulator() );
     }
+
+    SetSolverBudget(MaxORCAPlanes, MaxSolverIterations);
+    SetNeighbourSkin(NeighbourSkin);
+    SetDualTreeNeighbourSearch(bDualTreeNeighbourSearch);
+    SetSharedPairConstraints(bSharedPairConstraints);
+    SetWarmStartedSolve(bWarmStartedSolve);
+    SetVelocityNeighbourPruning(bVelocityNeighbourPruning, VelocityPruningMargin);
+    SetAdaptiveNeighbours(bAdaptiveNeighbours, AdaptiveNeighbourSmoothing, AdaptiveNeighbourHeadroom);
+    SetFixedTimeStep(bFixedTimeStep, FixedTimeStep, MaxSubsteps);
+    SetParallelSimulation(bParallelSimulation);
+    SetSimulationLOD(bSimulationLOD);
+    SetSolveTimeBudget(SolveTimeBudget);
+    SetMaxSolvedAgents(MaxSolvedAgents);
+    SetUrgencyScheduling(bUrgencyScheduling, MaxDeferredSteps);
 }
 
 void URVO3DSimulatorComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
@@ -30,9 +109,17 @@ void URVO3DSimulatorComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
     // Clear simulator
     if (HasSimulator())
     {
+        WaitForSimulation();
+        SimulationTask.SafeRelease();
         Simulator.Reset();
     }
 
+    // Released after the simulator, which may still point to it
+    Executor.Reset();
+
+    // Drops mutations that arrived too late
+    CommandQueue.Empty();
+
     // Clear Agent entries
     for (auto& Elem : AgentMap)
     {
@@ -49,33 +136,210 @@ void URVO3DSimulatorComponent::TickComponent(float DeltaTime, enum ELevelTick Ti
 
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-    // Prepares agent RVO properties
+    // Consumes the step dispatched on the previous tick before its inputs are overwritten. The results tick normally did already.
+    ConsumeSimulationTask();
+
+    // Mutations from other threads land between steps, before the inputs of the next step are gathered
+    ApplyQueuedCommands();
+
+    int32 NumSteps = 1;
+    float StepTime = DeltaTime;
+
+    if (bFixedTimeStep)
+    {
+        // Runs the whole fixed steps accumulated so far. Time beyond MaxSubsteps is dropped so a hitch cannot snowball.
+        TimeAccumulator += DeltaTime;
+        NumSteps = FMath::Min(FMath::FloorToInt(TimeAccumulator / FixedTimeStep), MaxSubsteps);
+        TimeAccumulator = FMath::Fmod(TimeAccumulator - NumSteps * FixedTimeStep, FixedTimeStep);
+        StepTime = FixedTimeStep;
+    }
+
+    if (NumSteps > 0)
+    {
+        FBox AgentBounds(ForceInit);
+        TArray<FVector> ViewLocations;
+
+        // Gathers the viewers agent LOD is measured from
+        if (bSimulationLOD && ! AgentLODDelegate.IsBound())
+        {
+            for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+            {
+                if (APlayerController* PlayerController = It->Get())
+                {
+                    FVector ViewLocation;
+                    FRotator ViewRotation;
+                    PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+                    ViewLocations.Add(ViewLocation);
+                }
+            }
+        }
+
+        // Prepares agent RVO properties
+        for (auto& Elem : AgentMap)
+        {
+            URVO3DAgentComponent* AgentComponent = Elem.Key;
+            const int32 AgentID = Elem.Value;
+
+            if (AgentComponent->HasUpdatedComponent())
+            {
+                const FVector Position(AgentComponent->GetAgentLocation());
+                const FVector Velocity(AgentComponent->GetAgentVelocity());
+                const FVector Preferred(AgentComponent->GetPreferredVelocity());
+
+                AgentBounds += Position;
+
+                if (bSimulationLOD && ! AgentComponent->IsPassive())
+                {
+                    UpdateAgentLOD(AgentComponent, AgentID, Position, ViewLocations);
+                }
+
+                RVO::Vector3 RVO_Pos(ToSimulationLocation(Position));
+                RVO::Vector3 RVO_Vel(Velocity.X, Velocity.Y, Velocity.Z);
+                RVO::Vector3 RVO_Prf(Preferred.X, Preferred.Y, Preferred.Z);
+
+                // Set agent position and preferred velocity
+                // for current RVO simulation step
+                Simulator->setAgentPosition(AgentID, RVO_Pos);
+                Simulator->setAgentVelocity(AgentID, RVO_Vel);
+                Simulator->setAgentPrefVelocity(AgentID, RVO_Prf);
+                Simulator->setAgentPassive(AgentID, AgentComponent->IsPassive());
+            }
+        }
+
+        // Rebases before the step once the agents have drifted away from the simulation origin
+        if (bAutoRebaseOrigin && AgentBounds.IsValid)
+        {
+            const FVector Center(AgentBounds.GetCenter());
+
+            if (FVector::DistSquared(Center, FVector(SimulationOrigin)) > FMath::Square(RebaseDistance))
+            {
+                SetSimulationOrigin(FIntVector(Center));
+            }
+        }
+
+        // Shares the solve time budget between the steps of the frame
+        Simulator->setSolveTimeBudget(SolveTimeBudget * .001f / NumSteps);
+
+        LaunchedSteps = NumSteps;
+
+        if (bAsyncSimulation)
+        {
+            // The step only touches the simulator, which the game thread leaves alone until the step is waited for
+            TSharedPtr<RVO::RVOSimulator, ESPMode::ThreadSafe> StepSimulator(Simulator);
+
+            SimulationTask = FFunctionGraphTask::CreateAndDispatchWhenReady([StepSimulator, StepTime, NumSteps]()
+            {
+                SCOPE_CYCLE_COUNTER(STAT_RVO3D_SimulationStep);
+                StepSimulator->setTimeStep(StepTime);
+
+                for (int32 Step = 0; Step < NumSteps; ++Step)
+                {
+                    StepSimulator->doStep();
+                }
+            }, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+        }
+        else
+        {
+            // Perform RVO simulation steps
+            {
+                SCOPE_CYCLE_COUNTER(STAT_RVO3D_SimulationStep);
+                Simulator->setTimeStep(StepTime);
+
+                for (int32 Step = 0; Step < NumSteps; ++Step)
+                {
+                    Simulator->doStep();
+                }
+            }
+
+            ApplySimulationResults();
+        }
+    }
+}
+
+void URVO3DSimulatorComponent::RegisterComponentTickFunctions(bool bRegister)
+{
+    Super::RegisterComponentTickFunctions(bRegister);
+
+    if (bRegister)
+    {
+        if (SetupActorComponentTickFunction(&ResultsTick))
+        {
+            ResultsTick.Target = this;
+            UpdateTickDependencies();
+        }
+    }
+    else if (ResultsTick.IsTickFunctionRegistered())
+    {
+        ResultsTick.UnRegisterTickFunction();
+    }
+}
+
+void URVO3DSimulatorComponent::UpdateTickDependencies()
+{
+    if (bAsyncSimulation)
+    {
+        // Inputs are gathered after movement, and the step overlaps the rest of the frame and the start of the next one
+        ResultsTick.RemovePrerequisite(this, PrimaryComponentTick);
+        PrimaryComponentTick.AddPrerequisite(this, ResultsTick);
+        SetTickGroup(TG_PostPhysics);
+    }
+    else
+    {
+        PrimaryComponentTick.RemovePrerequisite(this, ResultsTick);
+        ResultsTick.AddPrerequisite(this, PrimaryComponentTick);
+        SetTickGroup(TG_PrePhysics);
+    }
+}
+
+void URVO3DSimulatorComponent::TickSimulationResults(float DeltaTime)
+{
+    // Async steps leave their results to the next tick
+    ConsumeSimulationTask();
+
+    // Updates agent avoidance velocities and locks for the frame
     for (auto& Elem : AgentMap)
     {
         URVO3DAgentComponent* AgentComponent = Elem.Key;
-        const int32 AgentID = Elem.Value;
 
         if (AgentComponent->HasUpdatedComponent())
         {
-            const FVector Position(AgentComponent->GetAgentLocation());
-            const FVector Velocity(AgentComponent->GetAgentVelocity());
-            const FVector Preferred(AgentComponent->GetPreferredVelocity());
-
-            RVO::Vector3 RVO_Pos(Position.X, Position.Y, Position.Z);
-            RVO::Vector3 RVO_Vel(Velocity.X, Velocity.Y, Velocity.Z);
-            RVO::Vector3 RVO_Prf(Preferred.X, Preferred.Y, Preferred.Z);
-
-            // Set agent position and preferred velocity
-            // for current RVO simulation step
-            Simulator->setAgentPosition(AgentID, RVO_Pos);
-            Simulator->setAgentVelocity(AgentID, RVO_Vel);
-            Simulator->setAgentPrefVelocity(AgentID, RVO_Prf);
+            if (bFixedTimeStep)
+            {
+                // In async mode this runs before the primary tick, so it reads the accumulator of the previous tick. The velocities then lag one tick like the results, and still advance on ticks that launch no step.
+                AgentComponent->InterpolateAvoidanceVelocity(TimeAccumulator / FixedTimeStep);
+            }
+
+            AgentComponent->TickLockTimer(DeltaTime);
         }
     }
+}
 
-    // Perform RVO simulation step
-    Simulator->setTimeStep(DeltaTime);
-    Simulator->doStep();
+void FRVO3DSimulationResultsTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+    FActorComponentTickFunction::ExecuteTickHelper(Target, /*bTickInEditor=*/ false, DeltaTime, TickType, [this](float DilatedTime)
+    {
+        Target->TickSimulationResults(DilatedTime);
+    });
+}
+
+FString FRVO3DSimulationResultsTickFunction::DiagnosticMessage()
+{
+    return Target ? Target->GetFullName() + TEXT("[TickSimulationResults]") : TEXT("<NULL>[TickSimulationResults]");
+}
+
+void URVO3DSimulatorComponent::ApplySimulationResults()
+{
+    const RVO::SolverStats& SolverStats(Simulator->getSolverStats());
+    SET_DWORD_STAT(STAT_RVO3D_IsolatedAgents, SolverStats.isolatedAgents);
+    SET_DWORD_STAT(STAT_RVO3D_UnconstrainedAgents, SolverStats.unconstrainedAgents);
+    SET_DWORD_STAT(STAT_RVO3D_LinearProgram3Agents, SolverStats.linearProgram3Agents);
+    SET_DWORD_STAT(STAT_RVO3D_LinearProgram4Agents, SolverStats.linearProgram4Agents);
+    SET_DWORD_STAT(STAT_RVO3D_BudgetExceededAgents, SolverStats.budgetExceededAgents);
+    SET_DWORD_STAT(STAT_RVO3D_DeferredAgents, SolverStats.deferredAgents);
+    SET_DWORD_STAT(STAT_RVO3D_MaxSolveAge, SolverStats.maxSolveAge);
+
+    DeferredAgents = SolverStats.deferredAgents;
+    MaxSolveAge = SolverStats.maxSolveAge;
 
     // Applies agent computed RVO results
     for (auto& Elem : AgentMap)
@@ -87,12 +351,280 @@ void URVO3DSimulatorComponent::TickComponent(float DeltaTime, enum ELevelTick Ti
         {
             RVO::Vector3 RVO_Vel(Simulator->getAgentVelocity(AgentID));
             FVector Vel(RVO_Vel.x(), RVO_Vel.y(), RVO_Vel.z());
-            AgentComponent->SetAvoidanceVelocity(Vel, !Simulator->isAgentValid(AgentID));
-            AgentComponent->TickLockTimer(DeltaTime);
+
+            if (LaunchedSteps > 1)
+            {
+                // Interpolates from the previous substep rather than from the last step of the previous frame
+                RVO::Vector3 RVO_Prev(Simulator->getAgentPreviousVelocity(AgentID));
+                AgentComponent->SetSubstepVelocities(FVector(RVO_Prev.x(), RVO_Prev.y(), RVO_Prev.z()), Vel, !Simulator->isAgentValid(AgentID));
+            }
+            else
+            {
+                AgentComponent->SetStepVelocity(Vel, !Simulator->isAgentValid(AgentID));
+            }
+        }
+    }
+}
+
+void URVO3DSimulatorComponent::ApplyQueuedCommands()
+{
+    TFunction<void()> Command;
+
+    while (CommandQueue.Dequeue(Command))
+    {
+        Command();
+    }
+}
+
+void URVO3DSimulatorComponent::UpdateAgentLOD(URVO3DAgentComponent* AgentComponent, int32 AgentID, const FVector& Position, const TArray<FVector>& ViewLocations)
+{
+    int32 Tier = 0;
+
+    if (AgentLODDelegate.IsBound())
+    {
+        Tier = AgentLODDelegate.Execute(AgentComponent);
+    }
+    else if (ViewLocations.Num() > 0)
+    {
+        float ViewDistanceSq = MAX_flt;
+
+        for (const FVector& ViewLocation : ViewLocations)
+        {
+            ViewDistanceSq = FMath::Min(ViewDistanceSq, FVector::DistSquared(Position, ViewLocation));
+        }
+
+        while (Tier < LODTiers.Num() && ViewDistanceSq >= FMath::Square(LODTiers[Tier].Distance))
+        {
+            ++Tier;
+        }
+    }
+
+    Tier = FMath::Clamp(Tier, 0, LODTiers.Num());
+
+    if (Tier != AgentComponent->LODTier)
+    {
+        AgentComponent->LODTier = Tier;
+        Simulator->setAgentUpdateInterval(AgentID, Tier > 0 ? FMath::Max(LODTiers[Tier - 1].UpdateInterval, 1) : 1);
+    }
+}
+
+void URVO3DSimulatorComponent::ApplyWorldOffset(const FVector& InOffset, bool bWorldShift)
+{
+    Super::ApplyWorldOffset(InOffset, bWorldShift);
+
+    // Agents move with the world, so moving the origin along keeps their local coordinates unchanged
+    SimulationOrigin += FIntVector(InOffset);
+}
+
+RVO::Vector3 URVO3DSimulatorComponent::ToSimulationLocation(const FVector& Location) const
+{
+    const FVector LocalLocation(Location - FVector(SimulationOrigin));
+    return RVO::Vector3(LocalLocation.X, LocalLocation.Y, LocalLocation.Z);
+}
+
+void URVO3DSimulatorComponent::ConsumeSimulationTask()
+{
+    if (SimulationTask.IsValid())
+    {
+        WaitForSimulation();
+        SimulationTask.SafeRelease();
+
+        // Only async steps leave their results to the next tick
+        if (bAsyncSimulation)
+        {
+            ApplySimulationResults();
         }
     }
 }
 
+void URVO3DSimulatorComponent::SetAsyncSimulation(bool bInAsyncSimulation)
+{
+    // A pending step is finished under the mode it was launched in, so that no sync step runs alongside it and its results are not lost
+    ConsumeSimulationTask();
+
+    bAsyncSimulation = bInAsyncSimulation;
+
+    if (ResultsTick.IsTickFunctionRegistered())
+    {
+        UpdateTickDependencies();
+    }
+}
+
+void URVO3DSimulatorComponent::SetParallelSimulation(bool bInParallelSimulation)
+{
+    bParallelSimulation = bInParallelSimulation;
+
+    if (bParallelSimulation && ! Executor.IsValid())
+    {
+        Executor = MakeShareable( new FRVO3DTaskGraphExecutor() );
+    }
+
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        Simulator->setExecutor(bParallelSimulation ? Executor.Get() : NULL);
+    }
+}
+
+void URVO3DSimulatorComponent::SetFixedTimeStep(bool bInFixedTimeStep, float InFixedTimeStep, int32 InMaxSubsteps)
+{
+    bFixedTimeStep = bInFixedTimeStep;
+    FixedTimeStep = FMath::Max(InFixedTimeStep, .001f);
+    MaxSubsteps = FMath::Max(InMaxSubsteps, 1);
+    TimeAccumulator = 0.f;
+}
+
+void URVO3DSimulatorComponent::SetSolveTimeBudget(float InSolveTimeBudget)
+{
+    SolveTimeBudget = FMath::Max(InSolveTimeBudget, 0.f);
+}
+
+void URVO3DSimulatorComponent::SetMaxSolvedAgents(int32 InMaxSolvedAgents)
+{
+    MaxSolvedAgents = FMath::Max(InMaxSolvedAgents, 0);
+
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        Simulator->setMaxSolvedAgents(MaxSolvedAgents);
+    }
+}
+
+void URVO3DSimulatorComponent::SetUrgencyScheduling(bool bInUrgencyScheduling, int32 InMaxDeferredSteps)
+{
+    bUrgencyScheduling = bInUrgencyScheduling;
+    MaxDeferredSteps = FMath::Max(InMaxDeferredSteps, 1);
+
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        Simulator->setUrgencyScheduling(bUrgencyScheduling, MaxDeferredSteps);
+    }
+}
+
+void URVO3DSimulatorComponent::SetSimulationLOD(bool bInSimulationLOD)
+{
+    bSimulationLOD = bInSimulationLOD;
+
+    // Agents return to full rate
+    if (! bSimulationLOD && HasSimulator())
+    {
+        WaitForSimulation();
+
+        for (auto& Elem : AgentMap)
+        {
+            Elem.Key->LODTier = 0;
+            Simulator->setAgentUpdateInterval(Elem.Value, 1);
+        }
+    }
+}
+
+void URVO3DSimulatorComponent::SetAgentLODDelegate(const FRVO3DAgentLODDelegate& InAgentLODDelegate)
+{
+    AgentLODDelegate = InAgentLODDelegate;
+}
+
+void URVO3DSimulatorComponent::WaitForSimulation()
+{
+    if (SimulationTask.IsValid())
+    {
+        FTaskGraphInterface::Get().WaitUntilTaskCompletes(SimulationTask, ENamedThreads::GameThread);
+    }
+}
+
+void URVO3DSimulatorComponent::SetSimulationOrigin(const FIntVector& InSimulationOrigin)
+{
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        const FVector Offset(InSimulationOrigin - SimulationOrigin);
+        Simulator->shiftOrigin(RVO::Vector3(Offset.X, Offset.Y, Offset.Z));
+    }
+
+    SimulationOrigin = InSimulationOrigin;
+}
+
+void URVO3DSimulatorComponent::SetSolverBudget(int32 InMaxORCAPlanes, int32 InMaxSolverIterations)
+{
+    MaxORCAPlanes = FMath::Max(InMaxORCAPlanes, 0);
+    MaxSolverIterations = FMath::Max(InMaxSolverIterations, 0);
+
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        Simulator->setSolverBudget(MaxORCAPlanes, MaxSolverIterations);
+    }
+}
+
+void URVO3DSimulatorComponent::SetNeighbourSkin(float InNeighbourSkin)
+{
+    NeighbourSkin = FMath::Max(InNeighbourSkin, 0.f);
+
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        Simulator->setNeighborSkin(NeighbourSkin);
+    }
+}
+
+void URVO3DSimulatorComponent::SetDualTreeNeighbourSearch(bool bInDualTreeNeighbourSearch)
+{
+    bDualTreeNeighbourSearch = bInDualTreeNeighbourSearch;
+
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        Simulator->setDualTreeNeighborSearch(bDualTreeNeighbourSearch);
+    }
+}
+
+void URVO3DSimulatorComponent::SetSharedPairConstraints(bool bInSharedPairConstraints)
+{
+    bSharedPairConstraints = bInSharedPairConstraints;
+
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        Simulator->setSharedORCAPlanes(bSharedPairConstraints);
+    }
+}
+
+void URVO3DSimulatorComponent::SetWarmStartedSolve(bool bInWarmStartedSolve)
+{
+    bWarmStartedSolve = bInWarmStartedSolve;
+
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        Simulator->setWarmStartedSolve(bWarmStartedSolve);
+    }
+}
+
+void URVO3DSimulatorComponent::SetVelocityNeighbourPruning(bool bInVelocityNeighbourPruning, float InVelocityPruningMargin)
+{
+    bVelocityNeighbourPruning = bInVelocityNeighbourPruning;
+    VelocityPruningMargin = FMath::Max(InVelocityPruningMargin, 0.f);
+
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        Simulator->setVelocityPruning(bVelocityNeighbourPruning, VelocityPruningMargin);
+    }
+}
+
+void URVO3DSimulatorComponent::SetAdaptiveNeighbours(bool bInAdaptiveNeighbours, float InSmoothing, float InHeadroom)
+{
+    bAdaptiveNeighbours = bInAdaptiveNeighbours;
+    AdaptiveNeighbourSmoothing = FMath::Clamp(InSmoothing, .01f, 1.f);
+    AdaptiveNeighbourHeadroom = FMath::Max(InHeadroom, 1.f);
+
+    if (HasSimulator())
+    {
+        WaitForSimulation();
+        Simulator->setAdaptiveNeighbors(bAdaptiveNeighbours, AdaptiveNeighbourSmoothing, AdaptiveNeighbourHeadroom);
+    }
+}
+
 void URVO3DSimulatorComponent::AddAgentActor(AActor* AgentActor)
 {
     if (AgentActor)
@@ -128,18 +660,12 @@ void URVO3DSimulatorComponent::AddAgentComponent(URVO3DAgentComponent* AgentComp
 
     if (HasSimulator() && ! AgentMap.Contains(AgentComponent))
     {
+        WaitForSimulation();
         const FVector pos(AgentComponent->GetAgentLocation());
-        int32 AgentID = Simulator->addAgent(
-            RVO::Vector3(pos.X, pos.Y, pos.Z),
-            AgentComponent->GetNeighbourDistance(),
-            AgentComponent->GetMaxNeighbourCount(),
-            AgentComponent->GetTimeHorizon(),
-            AgentComponent->GetAgentRadius(),
-            AgentComponent->GetAgentMaxSpeed(),
-            AgentComponent->GetAvoidanceGroupMask(),
-            AgentComponent->GetGroupsToAvoidMask(),
-            AgentComponent->GetGroupsToIgnoreMask()
-        );
+        // Agents with equal parameters share one archetype, recycled once its last agent is gone
+        const size_t ArchetypeNo = Simulator->acquireArchetype(MakeAgentArchetype(AgentComponent));
+
+        int32 AgentID = Simulator->addAgent(ToSimulationLocation(pos), ArchetypeNo);
 
         check(AgentID != RVO::RVO_ERROR);
 
@@ -155,6 +681,9 @@ void URVO3DSimulatorComponent::AddAgentComponent(URVO3DAgentComponent* AgentComp
         //    AgentComponent->GetGroupsToIgnoreMask()
         //);
 
+        // New agents are solved every step until their LOD is evaluated
+        AgentComponent->LODTier = 0;
+
         AgentMap.Emplace(AgentComponent, AgentID);
         AgentComponent->SetSimulatorComponent(this);
     }
@@ -164,38 +693,131 @@ void URVO3DSimulatorComponent::RemoveAgentComponent(URVO3DAgentComponent* AgentC
 {
     if (HasSimulator() && AgentComponent && AgentMap.Contains(AgentComponent))
     {
+        WaitForSimulation();
         const int32 AgentID = AgentMap.FindAndRemoveChecked(AgentComponent);
         Simulator->removeAgent(AgentID);
         AgentComponent->ResetSimulatorComponent();
     }
 }
 
-void URVO3DSimulatorComponent::UpdateIgnoredAgents(const URVO3DAgentComponent* AgentComponent)
+void URVO3DSimulatorComponent::UpdateAgentParameters(const URVO3DAgentComponent* AgentComponent)
 {
     if (! HasSimulator() || ! IsValid(AgentComponent))
     {
         return;
     }
 
+    WaitForSimulation();
+
     if (AgentMap.Contains(AgentComponent))
     {
         const int32 AgentID = AgentMap.FindChecked(AgentComponent);
-        TSet<int> IgnoredAgentIDs;
+        Simulator->setAgentArchetype(AgentID, Simulator->acquireArchetype(MakeAgentArchetype(AgentComponent)));
+    }
+}
+
+void URVO3DSimulatorComponent::UpdateAgentArchetype(const URVO3DAgentComponent* AgentComponent)
+{
+    if (! HasSimulator() || ! IsValid(AgentComponent))
+    {
+        return;
+    }
+
+    WaitForSimulation();
+
+    if (AgentMap.Contains(AgentComponent))
+    {
+        const int32 AgentID = AgentMap.FindChecked(AgentComponent);
+        Simulator->setArchetype(Simulator->getAgentArchetype(AgentID), MakeAgentArchetype(AgentComponent));
+    }
+}
+
+void URVO3DSimulatorComponent::UpdateIgnoredAgents(const URVO3DAgentComponent* AgentComponent)
+{
+    if (! HasSimulator() || ! IsValid(AgentComponent))
+    {
+        return;
+    }
+
+    WaitForSimulation();
 
+    if (AgentMap.Contains(AgentComponent))
+    {
+        const int32 AgentID = AgentMap.FindChecked(AgentComponent);
         const TSet<const URVO3DAgentComponent*>& IgnoredAgents(AgentComponent->IgnoredAgents);
+        TArray<size_t> IgnoredAgentIDs;
+        IgnoredAgentIDs.Reserve(IgnoredAgents.Num());
 
         for (const URVO3DAgentComponent* IgnoredAgent : IgnoredAgents)
         {
-            if (AgentMap.Contains(IgnoredAgent))
+            if (const int32* IgnoredID = AgentMap.Find(IgnoredAgent))
             {
-                IgnoredAgentIDs.Emplace(AgentMap.FindChecked(IgnoredAgent));
+                IgnoredAgentIDs.Add(*IgnoredID);
             }
         }
 
-        Simulator->setAgentIgnoredNeighbors(AgentID, IgnoredAgentIDs);
+        // The simulator sorts the IDs into its ignore list in one pass
+        Simulator->setAgentIgnoredNeighbors(AgentID, IgnoredAgentIDs.GetData(), IgnoredAgentIDs.Num());
     }
 }
 
+void URVO3DSimulatorComponent::EnqueueCommand(TFunction<void()>&& Command)
+{
+    CommandQueue.Enqueue(MoveTemp(Command));
+}
+
+void URVO3DSimulatorComponent::EnqueueAddAgentComponent(URVO3DAgentComponent* AgentComponent)
+{
+    TWeakObjectPtr<URVO3DAgentComponent> WeakAgent(AgentComponent);
+
+    EnqueueCommand([this, WeakAgent]()
+    {
+        AddAgentComponent(WeakAgent.Get());
+    });
+}
+
+void URVO3DSimulatorComponent::EnqueueRemoveAgentComponent(URVO3DAgentComponent* AgentComponent)
+{
+    TWeakObjectPtr<URVO3DAgentComponent> WeakAgent(AgentComponent);
+
+    EnqueueCommand([this, WeakAgent]()
+    {
+        RemoveAgentComponent(WeakAgent.Get());
+    });
+}
+
+void URVO3DSimulatorComponent::EnqueueUpdateAgentParameters(const URVO3DAgentComponent* AgentComponent)
+{
+    TWeakObjectPtr<const URVO3DAgentComponent> WeakAgent(AgentComponent);
+
+    EnqueueCommand([this, WeakAgent]()
+    {
+        UpdateAgentParameters(WeakAgent.Get());
+    });
+}
+
+void URVO3DSimulatorComponent::EnqueueAddIgnoredAgent(const URVO3DAgentComponent* AgentComponent, const URVO3DAgentComponent* IgnoredAgent)
+{
+    TWeakObjectPtr<const URVO3DAgentComponent> WeakAgent(AgentComponent);
+    TWeakObjectPtr<const URVO3DAgentComponent> WeakIgnoredAgent(IgnoredAgent);
+
+    EnqueueCommand([this, WeakAgent, WeakIgnoredAgent]()
+    {
+        AddIgnoredAgent(WeakAgent.Get(), WeakIgnoredAgent.Get());
+    });
+}
+
+void URVO3DSimulatorComponent::EnqueueRemoveIgnoredAgent(const URVO3DAgentComponent* AgentComponent, const URVO3DAgentComponent* IgnoredAgent)
+{
+    TWeakObjectPtr<const URVO3DAgentComponent> WeakAgent(AgentComponent);
+    TWeakObjectPtr<const URVO3DAgentComponent> WeakIgnoredAgent(IgnoredAgent);
+
+    EnqueueCommand([this, WeakAgent, WeakIgnoredAgent]()
+    {
+        RemoveIgnoredAgent(WeakAgent.Get(), WeakIgnoredAgent.Get());
+    });
+}
+
 void URVO3DSimulatorComponent::AddIgnoredAgent(const URVO3DAgentComponent* AgentComponent, const URVO3DAgentComponent* IgnoredAgent)
 {
     if (! HasSimulator() || ! IsValid(AgentComponent) || ! IsValid(IgnoredAgent))
@@ -203,6 +825,8 @@ void URVO3DSimulatorComponent::AddIgnoredAgent(const URVO3DAgentComponent* Agent
         return;
     }
 
+    WaitForSimulation();
+
     if (AgentMap.Contains(AgentComponent) && AgentMap.Contains(IgnoredAgent))
     {
         const int32 AgentID = AgentMap.FindChecked(AgentComponent);
@@ -218,6 +842,8 @@ void URVO3DSimulatorComponent::RemoveIgnoredAgent(const URVO3DAgentComponent* Ag
         return;
     }
 
+    WaitForSimulation();
+
     if (AgentMap.Contains(AgentComponent) && AgentMap.Contains(IgnoredAgent))
     {
         const int32 AgentID = AgentMap.FindChecked(AgentComponent);
@@ -233,6 +859,8 @@ void URVO3DSimulatorComponent::ClearIgnoredAgents(const URVO3DAgentComponent* Ag
         return;
     }
 
+    WaitForSimulation();
+
     if (AgentMap.Contains(AgentComponent))
     {
         const int32 AgentID = AgentMap.FindChecked(AgentComponent);
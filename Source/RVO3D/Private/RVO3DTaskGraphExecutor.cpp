@@ -0,0 +1,32 @@
+#include "RVO3DTaskGraphExecutor.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+
+size_t FRVO3DTaskGraphExecutor::getNumThreads() const
+{
+    // The calling thread takes part in the loop
+    return FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+}
+
+void FRVO3DTaskGraphExecutor::parallelFor(size_t count, const std::function<void(size_t, size_t)>& body)
+{
+    const int32 Count = static_cast<int32>(count);
+
+    if (Count <= MinChunkSize)
+    {
+        if (Count > 0)
+        {
+            body(0, count);
+        }
+        return;
+    }
+
+    const int32 NumChunks = FMath::Max(FMath::Min(static_cast<int32>(getNumThreads()) * ChunksPerThread, Count / MinChunkSize), 1);
+
+    ParallelFor(NumChunks, [Count, NumChunks, &body](int32 Chunk)
+    {
+        const int32 Begin = static_cast<int32>(static_cast<int64>(Count) * Chunk / NumChunks);
+        const int32 End = static_cast<int32>(static_cast<int64>(Count) * (Chunk + 1) / NumChunks);
+        body(Begin, End);
+    });
+}
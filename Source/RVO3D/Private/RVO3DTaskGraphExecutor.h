@@ -0,0 +1,22 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Executor.h"
+
+/**
+ * Runs the parallel loops of the avoidance core on the engine's task graph workers
+ */
+class FRVO3DTaskGraphExecutor final : public RVO::Executor
+{
+public:
+    virtual size_t getNumThreads() const override;
+
+    virtual void parallelFor(size_t count, const std::function<void(size_t, size_t)>& body) override;
+
+private:
+    // Number of chunks per thread a loop is cut into, so that workers finishing early pick up the remaining chunks
+    static const int32 ChunksPerThread = 8;
+
+    // Smallest number of iterations in a chunk
+    static const int32 MinChunkSize = 16;
+};
@@ -2,6 +2,7 @@
 
 #include <cmath>
 #include <algorithm>
+#include <limits>
 
 #include "Definitions.h"
 #include "KdTree.h"
@@ -12,6 +13,11 @@ namespace RVO {
 	 */
 	const float RVO_EPSILON = 0.00001f;
 
+	/**
+	 * \brief   The distance to a plane, relative to the maximum speed, within which a solved velocity binds the plane.
+	 */
+	const float RVO_BINDING_TOLERANCE = 0.001f;
+
 	/**
 	 * \brief   Defines a directed line.
 	 */
@@ -39,7 +45,7 @@ namespace RVO {
 	 * \param   result        A reference to the result of the linear program.
 	 * \return  True if successful.
 	 */
-	bool linearProgram1(const std::vector<Plane> &planes, size_t planeNo, const Line &line, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
+	bool linearProgram1(const Plane *planes, size_t planeNo, const Line &line, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
 
 	/**
 	 * \brief   Solves a two-dimensional linear program on a specified plane subject to linear constraints defined by planes and a spherical constraint.
@@ -51,172 +57,602 @@ namespace RVO {
 	 * \param   result        A reference to the result of the linear program.
 	 * \return  True if successful.
 	 */
-	bool linearProgram2(const std::vector<Plane> &planes, size_t planeNo, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
+	bool linearProgram2(const Plane *planes, size_t planeNo, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
 
 	/**
 	 * \brief   Solves a three-dimensional linear program subject to linear constraints defined by planes and a spherical constraint.
 	 * \param   planes        Planes defining the linear constraints.
+	 * \param   numPlanes     The number of planes.
 	 * \param   radius        The radius of the spherical constraint.
 	 * \param   optVelocity   The optimization velocity.
 	 * \param   directionOpt  True if the direction should be optimized.
 	 * \param   result        A reference to the result of the linear program.
 	 * \return  The number of the plane it fails on, and the number of planes if successful.
 	 */
-	size_t linearProgram3(const std::vector<Plane> &planes, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
+	size_t linearProgram3(const Plane *planes, size_t numPlanes, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
 
 	/**
 	 * \brief   Solves a four-dimensional linear program subject to linear constraints defined by planes and a spherical constraint.
 	 * \param   planes     Planes defining the linear constraints.
+	 * \param   numPlanes  The number of planes.
 	 * \param   beginPlane The plane on which the 3-d linear program failed.
 	 * \param   radius     The radius of the spherical constraint.
+	 * \param   maxIterations  The maximum number of 3-d linear programs to be solved, or zero if unbounded.
+	 * \param   projPlanes Scratch storage for at least numPlanes - 1 projected planes.
 	 * \param   result     A reference to the result of the linear program.
+	 * \return  True if the iteration budget was exhausted before all planes were processed.
 	 */
-	void linearProgram4(const std::vector<Plane> &planes, size_t beginPlane, float radius, Vector3 &result);
+	bool linearProgram4(const Plane *planes, size_t numPlanes, size_t beginPlane, float radius, size_t maxIterations, Plane *projPlanes, Vector3 &result);
+
+	/**
+	 * \brief   Computes the determinant of the horizontal components of two vectors.
+	 * \param   vector1  The first vector.
+	 * \param   vector2  The second vector.
+	 * \return  The determinant of the two-dimensional square matrix formed by the x and y components of the vectors.
+	 */
+	inline float det2(const Vector3 &vector1, const Vector3 &vector2)
+	{
+		return vector1.x() * vector2.y() - vector1.y() * vector2.x();
+	}
+
+	/**
+	 * \brief   Returns the direction of the horizontal line of a vertical plane, with the permitted velocities on its left.
+	 * \param   plane  The vertical plane.
+	 * \return  The direction of the line.
+	 */
+	inline Vector3 planarDirection(const Plane &plane)
+	{
+		return Vector3(plane.normal.y(), -plane.normal.x(), 0.0f);
+	}
+
+	/**
+	 * \brief   Solves a one-dimensional linear program on a specified horizontal line subject to linear constraints defined by vertical planes and a circular constraint.
+	 * \param   planes        Vertical planes defining the linear constraints.
+	 * \param   planeNo       The plane on which the line lies.
+	 * \param   radius        The radius of the circular constraint.
+	 * \param   optVelocity   The horizontal optimization velocity.
+	 * \param   directionOpt  True if the direction should be optimized.
+	 * \param   result        A reference to the result of the linear program.
+	 * \return  True if successful.
+	 */
+	bool planarLinearProgram1(const Plane *planes, size_t planeNo, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
+
+	/**
+	 * \brief   Solves a two-dimensional linear program subject to linear constraints defined by vertical planes and a circular constraint.
+	 * \param   planes        Vertical planes defining the linear constraints.
+	 * \param   numPlanes     The number of planes.
+	 * \param   radius        The radius of the circular constraint.
+	 * \param   optVelocity   The horizontal optimization velocity.
+	 * \param   directionOpt  True if the direction should be optimized.
+	 * \param   result        A reference to the result of the linear program.
+	 * \return  The number of the plane it fails on, and the number of planes if successful.
+	 */
+	size_t planarLinearProgram2(const Plane *planes, size_t numPlanes, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
+
+	/**
+	 * \brief   Solves a two-dimensional linear program for the least penetrating velocity, subject to linear constraints defined by vertical planes and a circular constraint.
+	 * \param   planes         Vertical planes defining the linear constraints.
+	 * \param   numPlanes      The number of planes.
+	 * \param   beginPlane     The plane on which the 2-d linear program failed.
+	 * \param   radius         The radius of the circular constraint.
+	 * \param   maxIterations  The maximum number of 2-d linear programs to be solved, or zero if unbounded.
+	 * \param   projPlanes     Scratch storage for at least numPlanes - 1 projected planes.
+	 * \param   result         A reference to the result of the linear program.
+	 * \return  True if the iteration budget was exhausted before all planes were processed.
+	 */
+	bool planarLinearProgram3(const Plane *planes, size_t numPlanes, size_t beginPlane, float radius, size_t maxIterations, Plane *projPlanes, Vector3 &result);
 
 	Agent::Agent(RVOSimulator *sim)
-        : sim_(sim), id_(0), maxNeighbors_(0), maxSpeed_(0.0f), neighborDist_(0.0f), radius_(0.0f), timeHorizon_(0.0f), valid_(true)//, debug_(false)
+        : sim_(sim), id_(0), archetype_(NULL), archetypeNo_(RVO_ERROR), effectiveMaxNeighbors_(0), updateInterval_(1), lastSolveStep_(sim->stepCount_), timeToCollision_(0.0f), neighborsInRange_(0), neighborDensity_(0.0f), neighborRangeSq_(0.0f), valid_(true), passive_(false), solvePath_(SOLVE_ISOLATED), budgetExceeded_(false)//, debug_(false)
     {
     }
 
+	template <class Traits>
 	void Agent::computeNeighbors()
 	{
 		agentNeighbors_.clear();
+		neighborsInRange_ = 0;
+
+		if (archetype_->maxNeighbors > 0) {
+			if (sim_->neighborSkin_ > 0.0f) {
+				/* Filter the cached candidates instead of querying the tree. */
+				float rangeSq = archetype_->neighborDist * archetype_->neighborDist;
+
+				for (size_t i = 0; i < neighborCandidates_.size(); ++i) {
+					insertAgentNeighbor<Traits>(neighborCandidates_[i], rangeSq);
+				}
+			}
+			else {
+				sim_->kdTree_->computeAgentNeighbors<Traits>(this, archetype_->neighborDist * archetype_->neighborDist);
+			}
+		}
+	}
+
+	template <class Traits>
+	void Agent::computeNeighborCandidates()
+	{
+		neighborCandidates_.clear();
+		candidatePosition_ = position();
 
-		if (maxNeighbors_ > 0) {
-			sim_->kdTree_->computeAgentNeighbors(this, neighborDist_ * neighborDist_);
+		if (archetype_->maxNeighbors > 0) {
+			sim_->kdTree_->computeAgentNeighborCandidates<Traits>(this, sqr(archetype_->neighborDist + sim_->neighborSkin_));
 		}
 	}
 
+	template <class Traits>
 	void Agent::computeNewVelocity()
 	{
-		orcaPlanes_.clear();
-		const float invTimeHorizon = 1.0f / timeHorizon_;
+		budgetExceeded_ = false;
+
+		/* Planar agents keep their height and only solve for a horizontal velocity. */
+		const bool planar = archetype_->planar;
+		const Vector3 prefVelocity = planar ? Vector3(prefVelocity_.x(), prefVelocity_.y(), 0.0f) : prefVelocity_;
+
+		/* The preferred velocity clamped to the maximum speed is the optimum of an unconstrained solve. */
+		Vector3 clampedPrefVelocity = prefVelocity;
+
+		if (absSq(prefVelocity) > sqr(archetype_->maxSpeed)) {
+			clampedPrefVelocity = normalize(prefVelocity) * archetype_->maxSpeed;
+		}
+
+		if (agentNeighbors_.empty()) {
+			/* No neighbors. */
+			orcaPlanes_.clear();
+			bindingNeighbors_.clear();
+			newVelocity_ = clampedPrefVelocity;
+			solvePath_ = SOLVE_ISOLATED;
+			valid_ = true;
+			return;
+		}
+
+		const float invTimeHorizon = 1.0f / archetype_->timeHorizon;
+		const size_t numPlanes = getNumORCAPlanes();
+		const bool sharedPlanes = sim_->sharedORCAPlanes_;
         bool valid = true;
+        bool unconstrained = true;
+
+		if (!sharedPlanes) {
+			orcaPlanes_.resize(numPlanes);
+		}
 
 		/* Create agent ORCA planes. */
-		for (size_t i = 0; i < agentNeighbors_.size(); ++i) {
-			const Agent *const other = agentNeighbors_[i].second;
-			const Vector3 relativePosition = other->position_ - position_;
-			const Vector3 relativeVelocity = velocity_ - other->velocity_;
-			const float distSq = absSq(relativePosition);
-			const float combinedRadius = radius_ + other->radius_;
-			const float combinedRadiusSq = sqr(combinedRadius);
+		for (size_t i = 0; i < numPlanes; ++i) {
+			Plane &plane = orcaPlanes_[i];
 
-			Plane plane;
-			Vector3 u;
+			if (sharedPlanes && planeStates_[i] != PLANE_PENDING) {
+				/* Already created from the reciprocal side. */
+				if (planeStates_[i] == PLANE_INVALID) {
+					valid = false;
+				}
+			}
+			else {
+				Vector3 u;
 
-			if (distSq > combinedRadiusSq) {
-				/* No collision. */
-				const Vector3 w = relativeVelocity - invTimeHorizon * relativePosition;
-				/* Vector from cutoff center to relative velocity. */
-				const float wLengthSq = absSq(w);
+				if (!(planar ? computePlanarORCAPlane(agentNeighbors_[i].second, invTimeHorizon, plane.normal, u) : computeORCAPlane(agentNeighbors_[i].second, invTimeHorizon, plane.normal, u))) {
+					valid = false;
+				}
 
-				const float dotProduct = w * relativePosition;
+				/* A passive neighbor does not avoid back, so this agent takes the whole change in relative velocity. */
+				plane.point = getSolveVelocity() + (agentNeighbors_[i].second->passive_ ? 1.0f : 0.5f) * u;
+			}
 
-				if (dotProduct < 0.0f && sqr(dotProduct) > combinedRadiusSq * wLengthSq) {
-					/* Project on cut-off circle. */
-					const float wLength = std::sqrt(wLengthSq);
-					const Vector3 unitW = w / wLength;
+			if (unconstrained && plane.normal * (plane.point - clampedPrefVelocity) > 0.0f) {
+				unconstrained = false;
+			}
+		}
 
-					plane.normal = unitW;
-					u = (combinedRadius * invTimeHorizon - wLength) * unitW;
+        valid_ = valid;
 
-                    if (valid && FPlatformMath::IsNaN(wLength))
-                    {
-                        valid = false;
-                    }
-				}
-				else {
-					/* Project on cone. */
-					const float a = distSq;
-					const float b = relativePosition * relativeVelocity;
-					const float c = absSq(relativeVelocity) - absSq(cross(relativePosition, relativeVelocity)) / (distSq - combinedRadiusSq);
-					const float t = (b + std::sqrt(sqr(b) - a * c)) / a;
-					const Vector3 cw = relativeVelocity - t * relativePosition;
-					const float wLength = abs(cw);
-					const Vector3 unitW = cw / wLength;
-
-					plane.normal = unitW;
-					u = (combinedRadius * t - wLength) * unitW;
-
-                    if (valid && FPlatformMath::IsNaN(wLength))
-                    {
-                        valid = false;
-                    }
+		if (unconstrained) {
+			/* No plane is violated by the preferred velocity. */
+			newVelocity_ = clampedPrefVelocity;
+			solvePath_ = SOLVE_UNCONSTRAINED;
+			bindingNeighbors_.clear();
+			return;
+		}
+
+		if (sim_->warmStartedSolve_ && !bindingNeighbors_.empty()) {
+			/* Planes binding in the previous step likely bind again, so the incremental programs meet them first and confirm the others in one pass. */
+			size_t numBinding = 0;
+
+			for (size_t i = 0; i < numPlanes; ++i) {
+				if (std::find(bindingNeighbors_.begin(), bindingNeighbors_.end(), agentNeighbors_[i].second->id_) != bindingNeighbors_.end()) {
+					std::swap(orcaPlanes_[i], orcaPlanes_[numBinding]);
+					std::swap(agentNeighbors_[i], agentNeighbors_[numBinding]);
+					++numBinding;
 				}
 			}
+		}
+
+		/* The planar programs are one dimension lower, but take the same solve paths. */
+		const size_t planeFail = planar ? planarLinearProgram2(&orcaPlanes_[0], numPlanes, archetype_->maxSpeed, prefVelocity, false, newVelocity_) : linearProgram3(&orcaPlanes_[0], numPlanes, archetype_->maxSpeed, prefVelocity, false, newVelocity_);
+
+		if (planeFail < numPlanes) {
+			if (Traits::MaxNeighbors > 0) {
+				/* The neighbor count is bounded at compile time, so the projected planes fit on the stack. */
+				Plane projPlanes[Traits::MaxNeighbors > 0 ? Traits::MaxNeighbors : 1];
+
+				budgetExceeded_ = planar ? planarLinearProgram3(&orcaPlanes_[0], numPlanes, planeFail, archetype_->maxSpeed, sim_->maxSolverIterations_, projPlanes, newVelocity_) : linearProgram4(&orcaPlanes_[0], numPlanes, planeFail, archetype_->maxSpeed, sim_->maxSolverIterations_, projPlanes, newVelocity_);
+			}
 			else {
-				/* Collision. */
-				const float invTimeStep = 1.0f / sim_->timeStep_;
-				const Vector3 w = relativeVelocity - invTimeStep * relativePosition;
-				const float wLength = abs(w);
+				std::vector<Plane> projPlanes(numPlanes);
+
+				budgetExceeded_ = planar ? planarLinearProgram3(&orcaPlanes_[0], numPlanes, planeFail, archetype_->maxSpeed, sim_->maxSolverIterations_, &projPlanes[0], newVelocity_) : linearProgram4(&orcaPlanes_[0], numPlanes, planeFail, archetype_->maxSpeed, sim_->maxSolverIterations_, &projPlanes[0], newVelocity_);
+			}
+
+			solvePath_ = SOLVE_LINEAR_PROGRAM_4;
+		}
+		else {
+			solvePath_ = SOLVE_LINEAR_PROGRAM_3;
+		}
+
+		if (sim_->warmStartedSolve_) {
+			/* Planes the new velocity lies on, or still violates when infeasible. */
+			const float tolerance = RVO_BINDING_TOLERANCE * archetype_->maxSpeed;
+
+			bindingNeighbors_.clear();
+
+			for (size_t i = 0; i < numPlanes; ++i) {
+				if (orcaPlanes_[i].normal * (orcaPlanes_[i].point - newVelocity_) > -tolerance) {
+					bindingNeighbors_.push_back(agentNeighbors_[i].second->id_);
+				}
+			}
+		}
+	}
+
+	bool Agent::computeORCAPlane(const Agent *other, float invTimeHorizon, Vector3 &normal, Vector3 &u) const
+	{
+		const size_t state = sim_->stateIndex_;
+		const Vector3 relativePosition = other->positions_[state] - positions_[state];
+		const Vector3 relativeVelocity = velocities_[state] - other->velocities_[state];
+		const float distSq = absSq(relativePosition);
+		const float combinedRadius = archetype_->radius + other->archetype_->radius;
+		const float combinedRadiusSq = sqr(combinedRadius);
+
+		if (distSq > combinedRadiusSq) {
+			/* No collision. */
+			const Vector3 w = relativeVelocity - invTimeHorizon * relativePosition;
+			/* Vector from cutoff center to relative velocity. */
+			const float wLengthSq = absSq(w);
+
+			const float dotProduct = w * relativePosition;
+
+			if (dotProduct < 0.0f && sqr(dotProduct) > combinedRadiusSq * wLengthSq) {
+				/* Project on cut-off circle. */
+				const float wLength = std::sqrt(wLengthSq);
 				const Vector3 unitW = w / wLength;
 
-                if (valid && FPlatformMath::IsNaN(wLength))
-                {
-                    valid = false;
-                }
+				normal = unitW;
+				u = (combinedRadius * invTimeHorizon - wLength) * unitW;
 
-				plane.normal = unitW;
-				u = (combinedRadius * invTimeStep - wLength) * unitW;
+				return !isNaN(wLength);
+			}
+			else {
+				/* Project on cone. */
+				const float a = distSq;
+				const float b = relativePosition * relativeVelocity;
+				const float c = absSq(relativeVelocity) - absSq(cross(relativePosition, relativeVelocity)) / (distSq - combinedRadiusSq);
+				const float t = (b + std::sqrt(sqr(b) - a * c)) / a;
+				const Vector3 cw = relativeVelocity - t * relativePosition;
+				const float wLength = abs(cw);
+				const Vector3 unitW = cw / wLength;
+
+				normal = unitW;
+				u = (combinedRadius * t - wLength) * unitW;
+
+				return !isNaN(wLength);
 			}
+		}
+		else {
+			/* Collision. */
+			/* The velocity is kept until the next solve, so the overlap is resolved over the whole interval. */
+			const float invTimeStep = 1.0f / (sim_->timeStep_ * getSolveInterval());
+			const Vector3 w = relativeVelocity - invTimeStep * relativePosition;
+			const float wLength = abs(w);
+			const Vector3 unitW = w / wLength;
+
+			normal = unitW;
+			u = (combinedRadius * invTimeStep - wLength) * unitW;
 
-			plane.point = velocity_ + 0.5f * u;
-			orcaPlanes_.push_back(plane);
+			return !isNaN(wLength);
 		}
+	}
+
+	bool Agent::computePlanarORCAPlane(const Agent *other, float invTimeHorizon, Vector3 &normal, Vector3 &u) const
+	{
+		const size_t state = sim_->stateIndex_;
+		const Vector3 relativePosition(other->positions_[state].x() - positions_[state].x(), other->positions_[state].y() - positions_[state].y(), 0.0f);
+		const Vector3 relativeVelocity(velocities_[state].x() - other->velocities_[state].x(), velocities_[state].y() - other->velocities_[state].y(), 0.0f);
+		const float distSq = absSq(relativePosition);
+		/* The other agent is the cross section of the combined sphere at the height of this agent. */
+		const float combinedRadiusSq = sqr(archetype_->radius + other->archetype_->radius) - sqr(other->positions_[state].z() - positions_[state].z());
+		const float combinedRadius = std::sqrt(std::max(combinedRadiusSq, 0.0f));
+		Vector3 direction;
+
+		if (distSq > combinedRadiusSq) {
+			/* No collision. */
+			const Vector3 w = relativeVelocity - invTimeHorizon * relativePosition;
+			/* Vector from cutoff center to relative velocity. */
+			const float wLengthSq = absSq(w);
+
+			const float dotProduct1 = w * relativePosition;
+
+			if (dotProduct1 < 0.0f && sqr(dotProduct1) > combinedRadiusSq * wLengthSq) {
+				/* Project on cut-off circle. */
+				const float wLength = std::sqrt(wLengthSq);
+				const Vector3 unitW = w / wLength;
+
+				direction = Vector3(unitW.y(), -unitW.x(), 0.0f);
+				u = (combinedRadius * invTimeHorizon - wLength) * unitW;
+			}
+			else {
+				/* Project on legs. */
+				const float leg = std::sqrt(distSq - combinedRadiusSq);
+
+				if (det2(relativePosition, w) > 0.0f) {
+					/* Project on left leg. */
+					direction = Vector3(relativePosition.x() * leg - relativePosition.y() * combinedRadius, relativePosition.x() * combinedRadius + relativePosition.y() * leg, 0.0f) / distSq;
+				}
+				else {
+					/* Project on right leg. */
+					direction = -Vector3(relativePosition.x() * leg + relativePosition.y() * combinedRadius, -relativePosition.x() * combinedRadius + relativePosition.y() * leg, 0.0f) / distSq;
+				}
 
-		const size_t planeFail = linearProgram3(orcaPlanes_, maxSpeed_, prefVelocity_, false, newVelocity_);
+				const float dotProduct2 = relativeVelocity * direction;
 
-		if (planeFail < orcaPlanes_.size()) {
-			linearProgram4(orcaPlanes_, planeFail, maxSpeed_, newVelocity_);
+				u = dotProduct2 * direction - relativeVelocity;
+			}
+		}
+		else {
+			/* Collision. */
+			/* The velocity is kept until the next solve, so the overlap is resolved over the whole interval. */
+			const float invTimeStep = 1.0f / (sim_->timeStep_ * getSolveInterval());
+			const Vector3 w = relativeVelocity - invTimeStep * relativePosition;
+			const float wLength = abs(w);
+			const Vector3 unitW = w / wLength;
+
+			direction = Vector3(unitW.y(), -unitW.x(), 0.0f);
+			u = (combinedRadius * invTimeStep - wLength) * unitW;
 		}
 
-        valid_ = valid;
+		/* The line is stored as the vertical plane through it, with the permitted velocities behind the normal. */
+		normal = Vector3(-direction.y(), direction.x(), 0.0f);
+
+		return !isNaN(normal.x()) && !isNaN(u.x());
+	}
+
+	void Agent::prepareSharedORCAPlanes()
+	{
+		const size_t numPlanes = getNumORCAPlanes();
+
+		orcaPlanes_.resize(numPlanes);
+		planeStates_.assign(numPlanes, PLANE_PENDING);
+	}
+
+	void Agent::computeSharedORCAPlanes()
+	{
+		const float invTimeHorizon = 1.0f / archetype_->timeHorizon;
+		const size_t numPlanes = orcaPlanes_.size();
+
+		for (size_t i = 0; i < numPlanes; ++i) {
+			Agent *const other = const_cast<Agent *>(agentNeighbors_[i].second);
+
+			/* Each unordered pair is handled by the agent with the lower id. The mirrored plane is only exact for equal time horizons, solve intervals and solve dimensions, and passive agents take no share. */
+			if (planeStates_[i] != PLANE_PENDING || other->id_ < id_ || other->archetype_->timeHorizon != archetype_->timeHorizon || other->getSolveInterval() != getSolveInterval() || other->archetype_->planar != archetype_->planar || other->passive_) {
+				continue;
+			}
+
+			const size_t otherNumPlanes = other->orcaPlanes_.size();
+			size_t j = 0;
+
+			while (j < otherNumPlanes && other->agentNeighbors_[j].second != this) {
+				++j;
+			}
+
+			if (j == otherNumPlanes) {
+				/* Not mutual, other creates its own planes. */
+				continue;
+			}
+
+			Vector3 normal;
+			Vector3 u;
+			const bool computed = archetype_->planar ? computePlanarORCAPlane(other, invTimeHorizon, normal, u) : computeORCAPlane(other, invTimeHorizon, normal, u);
+			const PlaneState state = computed ? PLANE_VALID : PLANE_INVALID;
+
+			orcaPlanes_[i].normal = normal;
+			orcaPlanes_[i].point = getSolveVelocity() + 0.5f * u;
+			planeStates_[i] = state;
+
+			/* Relative position, relative velocity and u of the reciprocal side are exact negations. */
+			other->orcaPlanes_[j].normal = -normal;
+			other->orcaPlanes_[j].point = other->getSolveVelocity() + 0.5f * -u;
+			other->planeStates_[j] = state;
+		}
+	}
+
+	size_t Agent::getNumORCAPlanes() const
+	{
+		/* Nearest neighbors come first, so a plane budget drops the farthest constraints. */
+		if (sim_->maxORCAPlanes_ > 0 && agentNeighbors_.size() > sim_->maxORCAPlanes_) {
+			return sim_->maxORCAPlanes_;
+		}
+
+		return agentNeighbors_.size();
 	}
 
+	template <class Traits>
 	void Agent::insertAgentNeighbor(const Agent *agent, float &rangeSq)
 	{
 		if (this != agent) {
-            if (shouldIgnoreGroup(agent->avoidanceGroup_) || agentsToIgnore_.Contains(agent->id_))
+            if (shouldIgnoreAgent<Traits>(agent))
             {
                 return;
             }
 
-			const float distSq = absSq(position_ - agent->position_);
+			/* Reading the other agent through the state index of this agent saves loading its simulator. */
+			const size_t state = sim_->stateIndex_;
 
-			if (distSq < rangeSq) {
-				if (agentNeighbors_.size() < maxNeighbors_) {
-					agentNeighbors_.push_back(std::make_pair(distSq, agent));
-				}
+			insertAgentNeighbor<Traits>(agent, absSq(positions_[state] - agent->positions_[state]), rangeSq);
+		}
+	}
 
-				size_t i = agentNeighbors_.size() - 1;
+	template <class Traits>
+	void Agent::insertAgentNeighbor(const Agent *agent, float distSq, float &rangeSq)
+	{
+		if (distSq < rangeSq) {
+			if (archetype_->planar && std::fabs(agent->positions_[sim_->stateIndex_].z() - position().z()) >= archetype_->radius + agent->archetype_->radius) {
+				/* Agents above or below the layer of a planar agent cannot collide with it. */
+				return;
+			}
 
-				while (i != 0 && distSq < agentNeighbors_[i - 1].first) {
-					agentNeighbors_[i] = agentNeighbors_[i - 1];
-					--i;
-				}
+			if (sim_->velocityPruning_ && !canCollideWithinTimeHorizon(agent, distSq)) {
+				return;
+			}
 
-				agentNeighbors_[i] = std::make_pair(distSq, agent);
+			++neighborsInRange_;
 
-				if (agentNeighbors_.size() == maxNeighbors_) {
-					rangeSq = agentNeighbors_.back().first;
-				}
+			const size_t maxNeighbors = Traits::MaxNeighbors > 0 ? std::min(effectiveMaxNeighbors_, Traits::MaxNeighbors) : effectiveMaxNeighbors_;
+
+			if (agentNeighbors_.size() < maxNeighbors) {
+				agentNeighbors_.push_back(std::make_pair(distSq, agent));
+			}
+
+			size_t i = agentNeighbors_.size() - 1;
+
+			while (i != 0 && distSq < agentNeighbors_[i - 1].first) {
+				agentNeighbors_[i] = agentNeighbors_[i - 1];
+				--i;
 			}
+
+			agentNeighbors_[i] = std::make_pair(distSq, agent);
+
+			if (agentNeighbors_.size() == maxNeighbors) {
+				rangeSq = agentNeighbors_.back().first;
+			}
+		}
+	}
+
+	void Agent::insertNeighborCandidate(const Agent *agent, float rangeSq)
+	{
+		/* Group masks and ignored agents are filtered per step, so that changing them does not invalidate the candidates. */
+		const size_t state = sim_->stateIndex_;
+
+		if (this != agent && absSq(positions_[state] - agent->positions_[state]) < rangeSq) {
+			neighborCandidates_.push_back(agent);
+		}
+	}
+
+	bool Agent::canCollideWithinTimeHorizon(const Agent *agent, float distSq) const
+	{
+		const float combinedRadiusSq = sqr(archetype_->radius + agent->archetype_->radius + sim_->velocityPruningMargin_);
+
+		if (distSq <= combinedRadiusSq) {
+			return true;
+		}
+
+		/* Closest approach within the time horizon, assuming both agents keep their current velocities. */
+		const size_t state = sim_->stateIndex_;
+		const Vector3 relativePosition = agent->positions_[state] - positions_[state];
+		const Vector3 relativeVelocity = velocities_[state] - agent->velocities_[state];
+		const float relativeSpeedSq = absSq(relativeVelocity);
+
+		if (relativeSpeedSq <= RVO_EPSILON) {
+			return false;
 		}
+
+		const float t = std::min(std::max((relativePosition * relativeVelocity) / relativeSpeedSq, 0.0f), archetype_->timeHorizon);
+
+		return absSq(relativePosition - t * relativeVelocity) <= combinedRadiusSq;
+	}
+
+	template <class Traits>
+	bool Agent::shouldIgnoreAgent(const Agent *agent) const
+	{
+		return (Traits::GroupMasks && shouldIgnoreGroup(agent->archetype_->avoidanceGroup)) || (Traits::IgnoreLists && agentsToIgnore_.contains(agent->id_));
 	}
 
 	bool Agent::shouldIgnoreGroup(int otherGroupMask) const
 	{
-		return ((groupsToAvoid_ & otherGroupMask) == 0) || ((groupsToIgnore_ & otherGroupMask) != 0);
+		return ((archetype_->groupsToAvoid & otherGroupMask) == 0) || ((archetype_->groupsToIgnore & otherGroupMask) != 0);
+	}
+
+	Vector3 Agent::getClampedPrefVelocity() const
+	{
+		const Vector3 prefVelocity = archetype_->planar ? Vector3(prefVelocity_.x(), prefVelocity_.y(), 0.0f) : prefVelocity_;
+
+		return absSq(prefVelocity) > sqr(archetype_->maxSpeed) ? normalize(prefVelocity) * archetype_->maxSpeed : prefVelocity;
+	}
+
+	float Agent::computeTimeToCollision() const
+	{
+		const size_t state = sim_->stateIndex_;
+		const Vector3 velocity = getClampedPrefVelocity();
+		float timeToCollision = std::numeric_limits<float>::infinity();
+
+		for (size_t i = 0; i < agentNeighbors_.size(); ++i) {
+			const Agent *const other = agentNeighbors_[i].second;
+			const Vector3 relativePosition = other->positions_[state] - positions_[state];
+			const Vector3 relativeVelocity = velocity - other->velocities_[state];
+			const float combinedRadius = archetype_->radius + other->archetype_->radius;
+			const float c = absSq(relativePosition) - sqr(combinedRadius);
+
+			if (c <= 0.0f) {
+				/* Already colliding. */
+				return 0.0f;
+			}
+
+			const float a = absSq(relativeVelocity);
+			const float b = relativePosition * relativeVelocity;
+			const float discriminant = sqr(b) - a * c;
+
+			if (b > 0.0f && discriminant > 0.0f) {
+				/* Earliest root of |relativePosition - t * relativeVelocity| = combinedRadius. */
+				timeToCollision = std::min(timeToCollision, (b - std::sqrt(discriminant)) / a);
+			}
+		}
+
+		return timeToCollision;
+	}
+
+	Vector3 Agent::getSolveVelocity() const
+	{
+		return archetype_->planar ? Vector3(velocity().x(), velocity().y(), 0.0f) : velocity();
+	}
+
+	void Agent::resetNeighborBudget()
+	{
+		effectiveMaxNeighbors_ = archetype_->maxNeighbors;
+		neighborDensity_ = static_cast<float>(archetype_->maxNeighbors);
+		neighborsInRange_ = 0;
+	}
+
+	void Agent::updateNeighborBudget()
+	{
+		/* Counted by the latest neighbor search, which may have run on steps the agent was not solved. */
+		neighborDensity_ += sim_->adaptiveNeighborSmoothing_ * (static_cast<float>(neighborsInRange_) - neighborDensity_);
+
+		if (archetype_->maxNeighbors > 0) {
+			/* A saturated neighbor set counts more candidates than slots, so the budget grows until it covers the local density. */
+			const size_t lowerBound = std::max<size_t>(archetype_->minNeighbors, 1);
+			const size_t budget = static_cast<size_t>(std::ceil(neighborDensity_ * sim_->adaptiveNeighborHeadroom_));
+
+			effectiveMaxNeighbors_ = std::min(std::max(budget, lowerBound), archetype_->maxNeighbors);
+		}
+		else {
+			effectiveMaxNeighbors_ = 0;
+		}
 	}
 
 	void Agent::update()
 	{
-		velocity_ = newVelocity_;
-		position_ += velocity_ * sim_->timeStep_;
+		/* Other agents may still be solving against the current state. */
+		const size_t nextState = sim_->stateIndex_ ^ 1;
+
+		velocities_[nextState] = newVelocity_;
+		positions_[nextState] = position() + newVelocity_ * sim_->timeStep_;
 	}
 
-	bool linearProgram1(const std::vector<Plane> &planes, size_t planeNo, const Line &line, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
+	bool linearProgram1(const Plane *planes, size_t planeNo, const Line &line, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
 	{
 		const float dotProduct = line.point * line.direction;
 		const float discriminant = sqr(dotProduct) + sqr(radius) - absSq(line.point);
@@ -289,7 +725,7 @@ namespace RVO {
 		return true;
 	}
 
-	bool linearProgram2(const std::vector<Plane> &planes, size_t planeNo, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
+	bool linearProgram2(const Plane *planes, size_t planeNo, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
 	{
 		const float planeDist = planes[planeNo].point * planes[planeNo].normal;
 		const float planeDistSq = sqr(planeDist);
@@ -353,7 +789,7 @@ namespace RVO {
 		return true;
 	}
 
-	size_t linearProgram3(const std::vector<Plane> &planes, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
+	size_t linearProgram3(const Plane *planes, size_t numPlanes, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
 	{
 		if (directionOpt) {
 			/* Optimize direction. Note that the optimization velocity is of unit length in this case. */
@@ -368,7 +804,7 @@ namespace RVO {
 			result = optVelocity;
 		}
 
-		for (size_t i = 0; i < planes.size(); ++i) {
+		for (size_t i = 0; i < numPlanes; ++i) {
 			if (planes[i].normal * (planes[i].point - result) > 0.0f) {
 				/* Result does not satisfy constraint i. Compute new optimal result. */
 				const Vector3 tempResult = result;
@@ -380,17 +816,24 @@ namespace RVO {
 			}
 		}
 
-		return planes.size();
+		return numPlanes;
 	}
 
-	void linearProgram4(const std::vector<Plane> &planes, size_t beginPlane, float radius, Vector3 &result)
+	bool linearProgram4(const Plane *planes, size_t numPlanes, size_t beginPlane, float radius, size_t maxIterations, Plane *projPlanes, Vector3 &result)
 	{
 		float distance = 0.0f;
+		size_t iterations = 0;
 
-		for (size_t i = beginPlane; i < planes.size(); ++i) {
+		for (size_t i = beginPlane; i < numPlanes; ++i) {
 			if (planes[i].normal * (planes[i].point - result) > distance) {
 				/* Result does not satisfy constraint of plane i. */
-				std::vector<Plane> projPlanes;
+				if (maxIterations > 0 && iterations == maxIterations) {
+					/* Budget exhausted. Keep the least penetrating velocity found for planes 0 to i - 1. */
+					return true;
+				}
+
+				++iterations;
+				size_t numProjPlanes = 0;
 
 				for (size_t j = 0; j < i; ++j) {
 					Plane plane;
@@ -415,12 +858,12 @@ namespace RVO {
 					}
 
 					plane.normal = normalize(planes[j].normal - planes[i].normal);
-					projPlanes.push_back(plane);
+					projPlanes[numProjPlanes++] = plane;
 				}
 
 				const Vector3 tempResult = result;
 
-				if (linearProgram3(projPlanes, radius, planes[i].normal, true, result) < projPlanes.size()) {
+				if (linearProgram3(projPlanes, numProjPlanes, radius, planes[i].normal, true, result) < numProjPlanes) {
 					/* This should in principle not happen.  The result is by definition already in the feasible region of this linear program. If it fails, it is due to small floating point error, and the current result is kept. */
 					result = tempResult;
 				}
@@ -428,5 +871,178 @@ namespace RVO {
 				distance = planes[i].normal * (planes[i].point - result);
 			}
 		}
+
+		return false;
 	}
+
+	bool planarLinearProgram1(const Plane *planes, size_t planeNo, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
+	{
+		const Vector3 direction = planarDirection(planes[planeNo]);
+		const float dotProduct = planes[planeNo].point * direction;
+		const float discriminant = sqr(dotProduct) + sqr(radius) - absSq(planes[planeNo].point);
+
+		if (discriminant < 0.0f) {
+			/* Max speed circle fully invalidates line planeNo. */
+			return false;
+		}
+
+		const float sqrtDiscriminant = std::sqrt(discriminant);
+		float tLeft = -dotProduct - sqrtDiscriminant;
+		float tRight = -dotProduct + sqrtDiscriminant;
+
+		for (size_t i = 0; i < planeNo; ++i) {
+			const float denominator = det2(direction, planarDirection(planes[i]));
+			const float numerator = planes[i].normal * (planes[planeNo].point - planes[i].point);
+
+			if (std::fabs(denominator) <= RVO_EPSILON) {
+				/* Lines planeNo and i are (almost) parallel. */
+				if (numerator < 0.0f) {
+					return false;
+				}
+				else {
+					continue;
+				}
+			}
+
+			const float t = numerator / denominator;
+
+			if (denominator >= 0.0f) {
+				/* Line i bounds line planeNo on the right. */
+				tRight = std::min(tRight, t);
+			}
+			else {
+				/* Line i bounds line planeNo on the left. */
+				tLeft = std::max(tLeft, t);
+			}
+
+			if (tLeft > tRight) {
+				return false;
+			}
+		}
+
+		if (directionOpt) {
+			/* Optimize direction. */
+			if (optVelocity * direction > 0.0f) {
+				/* Take right extreme. */
+				result = planes[planeNo].point + tRight * direction;
+			}
+			else {
+				/* Take left extreme. */
+				result = planes[planeNo].point + tLeft * direction;
+			}
+		}
+		else {
+			/* Optimize closest point. */
+			const float t = direction * (optVelocity - planes[planeNo].point);
+
+			if (t < tLeft) {
+				result = planes[planeNo].point + tLeft * direction;
+			}
+			else if (t > tRight) {
+				result = planes[planeNo].point + tRight * direction;
+			}
+			else {
+				result = planes[planeNo].point + t * direction;
+			}
+		}
+
+		return true;
+	}
+
+	size_t planarLinearProgram2(const Plane *planes, size_t numPlanes, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
+	{
+		if (directionOpt) {
+			/* Optimize direction. Note that the optimization velocity is of unit length in this case. */
+			result = optVelocity * radius;
+		}
+		else if (absSq(optVelocity) > sqr(radius)) {
+			/* Optimize closest point and outside circle. */
+			result = normalize(optVelocity) * radius;
+		}
+		else {
+			/* Optimize closest point and inside circle. */
+			result = optVelocity;
+		}
+
+		for (size_t i = 0; i < numPlanes; ++i) {
+			if (planes[i].normal * (planes[i].point - result) > 0.0f) {
+				/* Result does not satisfy constraint i. Compute new optimal result. */
+				const Vector3 tempResult = result;
+
+				if (!planarLinearProgram1(planes, i, radius, optVelocity, directionOpt, result)) {
+					result = tempResult;
+					return i;
+				}
+			}
+		}
+
+		return numPlanes;
+	}
+
+	bool planarLinearProgram3(const Plane *planes, size_t numPlanes, size_t beginPlane, float radius, size_t maxIterations, Plane *projPlanes, Vector3 &result)
+	{
+		float distance = 0.0f;
+		size_t iterations = 0;
+
+		for (size_t i = beginPlane; i < numPlanes; ++i) {
+			if (planes[i].normal * (planes[i].point - result) > distance) {
+				/* Result does not satisfy constraint of line i. */
+				if (maxIterations > 0 && iterations == maxIterations) {
+					/* Budget exhausted. Keep the least penetrating velocity found for lines 0 to i - 1. */
+					return true;
+				}
+
+				++iterations;
+				size_t numProjPlanes = 0;
+				const Vector3 direction = planarDirection(planes[i]);
+
+				for (size_t j = 0; j < i; ++j) {
+					Plane plane;
+
+					const float determinant = det2(direction, planarDirection(planes[j]));
+
+					if (std::fabs(determinant) <= RVO_EPSILON) {
+						/* Line i and line j are (almost) parallel. */
+						if (planes[i].normal * planes[j].normal > 0.0f) {
+							/* Line i and line j point in the same direction. */
+							continue;
+						}
+						else {
+							/* Line i and line j point in opposite direction. */
+							plane.point = 0.5f * (planes[i].point + planes[j].point);
+						}
+					}
+					else {
+						plane.point = planes[i].point + ((planes[j].normal * (planes[i].point - planes[j].point)) / determinant) * direction;
+					}
+
+					plane.normal = normalize(planes[j].normal - planes[i].normal);
+					projPlanes[numProjPlanes++] = plane;
+				}
+
+				const Vector3 tempResult = result;
+
+				if (planarLinearProgram2(projPlanes, numProjPlanes, radius, planes[i].normal, true, result) < numProjPlanes) {
+					/* This should in principle not happen.  The result is by definition already in the feasible region of this linear program. If it fails, it is due to small floating point error, and the current result is kept. */
+					result = tempResult;
+				}
+
+				distance = planes[i].normal * (planes[i].point - result);
+			}
+		}
+
+		return false;
+	}
+
+#define RVO_INSTANTIATE_AGENT(Traits) \
+	template void Agent::computeNeighbors<Traits>(); \
+	template void Agent::computeNeighborCandidates<Traits>(); \
+	template void Agent::computeNewVelocity<Traits>(); \
+	template void Agent::insertAgentNeighbor<Traits>(const Agent *agent, float &rangeSq); \
+	template void Agent::insertAgentNeighbor<Traits>(const Agent *agent, float distSq, float &rangeSq); \
+	template bool Agent::shouldIgnoreAgent<Traits>(const Agent *agent) const;
+
+	RVO_SIMULATOR_TRAITS(RVO_INSTANTIATE_AGENT)
+
+#undef RVO_INSTANTIATE_AGENT
 }
@@ -5,9 +5,10 @@
 #include <utility>
 #include <vector>
 
+#include "IgnoreList.h"
+#include "Platform.h"
 #include "RVOSimulator.h"
 #include "Vector3.h"
-#include "Containers/Set.h"
 
 namespace RVO {
 	/**
@@ -15,6 +16,25 @@ namespace RVO {
 	 */
 	class Agent {
 	private:
+		/**
+		 * \brief   Defines the path taken by the last velocity solve of an agent.
+		 */
+		enum SolvePath {
+			SOLVE_ISOLATED,
+			SOLVE_UNCONSTRAINED,
+			SOLVE_LINEAR_PROGRAM_3,
+			SOLVE_LINEAR_PROGRAM_4
+		};
+
+		/**
+		 * \brief   Defines the state of an ORCA plane during the shared plane phase.
+		 */
+		enum PlaneState {
+			PLANE_PENDING,
+			PLANE_VALID,
+			PLANE_INVALID
+		};
+
 		/**
 		 * \brief   Constructs an agent instance.
 		 * \param   sim  The simulator instance.
@@ -23,21 +43,102 @@ namespace RVO {
 
 		/**
 		 * \brief   Computes the neighbors of this agent.
+		 * \tparam  Traits  The compile-time configuration of the simulation.
 		 */
+		template <class Traits>
 		void computeNeighbors();
 
+		/**
+		 * \brief   Computes the cached neighbor candidates of this agent, within the neighbor distance plus the neighbor skin of the simulation.
+		 * \tparam  Traits  The compile-time configuration of the simulation.
+		 */
+		template <class Traits>
+		void computeNeighborCandidates();
+
 		/**
 		 * \brief   Computes the new velocity of this agent.
+		 * \tparam  Traits  The compile-time configuration of the simulation.
 		 */
+		template <class Traits>
 		void computeNewVelocity();
 
+		/**
+		 * \brief   Computes the ORCA plane of this agent induced by another agent.
+		 * \param   other           A pointer to the other agent.
+		 * \param   invTimeHorizon  The inverse of the time horizon of this agent.
+		 * \param   normal          A reference to the normal of the plane.
+		 * \param   u               A reference to the smallest change in relative velocity that leaves the velocity obstacle. The plane passes through the velocity of this agent plus 0.5 * u.
+		 * \return  False if the plane could not be computed reliably.
+		 */
+		bool computeORCAPlane(const Agent *other, float invTimeHorizon, Vector3 &normal, Vector3 &u) const;
+
+		/**
+		 * \brief   Computes the ORCA line of this planar agent induced by another agent, as the vertical plane through the line.
+		 * \param   other           A pointer to the other agent. Its cross section at the height of this agent is taken into account.
+		 * \param   invTimeHorizon  The inverse of the time horizon of this agent.
+		 * \param   normal          A reference to the horizontal normal of the plane.
+		 * \param   u               A reference to the smallest change in horizontal relative velocity that leaves the velocity obstacle. The plane passes through the horizontal velocity plus 0.5 * u.
+		 * \return  False if the plane could not be computed reliably.
+		 */
+		bool computePlanarORCAPlane(const Agent *other, float invTimeHorizon, Vector3 &normal, Vector3 &u) const;
+
+		/**
+		 * \brief   Sizes the ORCA planes of this agent before the shared plane phase.
+		 */
+		void prepareSharedORCAPlanes();
+
+		/**
+		 * \brief   Computes the ORCA planes this agent shares with mutual neighbors of a higher id, and hands each of them its mirrored plane.
+		 */
+		void computeSharedORCAPlanes();
+
+		/**
+		 * \brief   Returns the number of ORCA planes of this agent, within the plane budget of the simulation.
+		 * \return  The number of nearest neighbors that induce an ORCA plane.
+		 */
+		size_t getNumORCAPlanes() const;
+
 		/**
 		 * \brief   Inserts an agent neighbor into the set of neighbors of this agent.
 		 * \param   agent    A pointer to the agent to be inserted.
 		 * \param   rangeSq  The squared range around this agent.
 		 */
+		template <class Traits>
 		void insertAgentNeighbor(const Agent *agent, float &rangeSq);
 
+		/**
+		 * \brief   Inserts an agent neighbor at a known squared distance into the set of neighbors of this agent, without checking whether it should be ignored.
+		 * \param   agent    A pointer to the agent to be inserted.
+		 * \param   distSq   The squared distance between this agent and the agent to be inserted.
+		 * \param   rangeSq  The squared range around this agent.
+		 */
+		template <class Traits>
+		void insertAgentNeighbor(const Agent *agent, float distSq, float &rangeSq);
+
+		/**
+		 * \brief   Inserts an agent into the cached neighbor candidates of this agent.
+		 * \param   agent    A pointer to the agent to be inserted.
+		 * \param   rangeSq  The squared range around this agent.
+		 */
+		void insertNeighborCandidate(const Agent *agent, float rangeSq);
+
+		/**
+		 * \brief   Checks whether the current relative motion of this agent and another agent can bring them within their combined radius, plus the velocity pruning margin of the simulation, inside the time horizon of this agent.
+		 * \param   agent   A pointer to the other agent.
+		 * \param   distSq  The squared distance between this agent and the other agent.
+		 * \return  False if the agents cannot collide within the time horizon.
+		 */
+		bool canCollideWithinTimeHorizon(const Agent *agent, float distSq) const;
+
+		/**
+		 * \brief   Checks whether an agent should be left out of the neighbors of this agent, by group mask or by ignore list.
+		 * \tparam  Traits  The compile-time configuration of the simulation. Group masks and ignore lists it disables are not checked.
+		 * \param   agent   A pointer to the other agent.
+		 * \return  Agent ignore flag.
+		 */
+		template <class Traits>
+		bool shouldIgnoreAgent(const Agent *agent) const;
+
 		/**
 		 * \brief   Checks whether a group mask should be considered on agent velocity calculation.
 		 * \param   otherGroupMask  Other group mask.
@@ -46,31 +147,94 @@ namespace RVO {
         bool shouldIgnoreGroup(int otherGroupMask) const;
 
 		/**
-		 * \brief   Updates the three-dimensional position and three-dimensional velocity of this agent.
+		 * \brief   Returns the preferred velocity of this agent in the space its new velocity is solved in, clamped to its maximum speed.
+		 * \return  The velocity an unconstrained solve of this agent returns.
+		 */
+		Vector3 getClampedPrefVelocity() const;
+
+		/**
+		 * \brief   Computes the earliest time at which this agent, moving at its clamped preferred velocity, collides with one of its neighbors, assuming they keep their current velocities.
+		 * \return  The time to collision, zero if already colliding, or infinity if no collision is ahead.
+		 */
+		float computeTimeToCollision() const;
+
+		/**
+		 * \brief   Returns the velocity of this agent in the space its new velocity is solved in.
+		 * \return  The horizontal velocity for planar agents, and the velocity otherwise.
+		 */
+		Vector3 getSolveVelocity() const;
+
+		/**
+		 * \brief   Resets the effective maximum neighbor count of this agent to its maximum neighbor count.
+		 */
+		void resetNeighborBudget();
+
+		/**
+		 * \brief   Updates the effective maximum neighbor count of this agent from the number of neighbors found within range during recent steps.
+		 */
+		void updateNeighborBudget();
+
+		/**
+		 * \brief   Checks whether this agent is due for a solve in the current simulation step.
+		 * \return  True if the agent is solved in the current step, and false if it keeps its last solved velocity.
+		 */
+		FORCEINLINE bool isUpdateDue() const { return getSolveInterval() == 1 || (sim_->stepCount_ + id_) % getSolveInterval() == 0; }
+
+		/**
+		 * \brief   Returns the number of simulation steps this agent keeps a solved velocity for. Agents with the same interval are staggered across steps by their number.
+		 * \return  The step multiple of the archetype times the update interval of the agent.
+		 */
+		FORCEINLINE size_t getSolveInterval() const { return archetype_->stepMultiple * updateInterval_; }
+
+		/**
+		 * \brief   Writes the three-dimensional position and three-dimensional velocity of this agent after the step to the next state buffer.
 		 */
 		void update();
 
+		/**
+		 * \brief   Returns the three-dimensional position of this agent in the current state buffer, which stays unchanged while a step runs.
+		 * \return  A reference to the current position.
+		 */
+		FORCEINLINE const Vector3 &position() const { return positions_[sim_->stateIndex_]; }
+		FORCEINLINE Vector3 &position() { return positions_[sim_->stateIndex_]; }
+
+		/**
+		 * \brief   Returns the three-dimensional velocity of this agent in the current state buffer, which stays unchanged while a step runs.
+		 * \return  A reference to the current velocity.
+		 */
+		FORCEINLINE const Vector3 &velocity() const { return velocities_[sim_->stateIndex_]; }
+		FORCEINLINE Vector3 &velocity() { return velocities_[sim_->stateIndex_]; }
+
+		/* The current state is read through sim_, so both share a cache line. */
+		RVOSimulator *sim_;
+		Vector3 positions_[2];
+		Vector3 velocities_[2];
 		Vector3 newVelocity_;
-		Vector3 position_;
 		Vector3 prefVelocity_;
-		Vector3 velocity_;
-		RVOSimulator *sim_;
 		size_t id_;
-		size_t maxNeighbors_;
-		float maxSpeed_;
-		float neighborDist_;
-		float radius_;
-		float timeHorizon_;
+		const AgentArchetype *archetype_;
+		size_t archetypeNo_;
+		size_t effectiveMaxNeighbors_;
+		size_t updateInterval_;
+		size_t lastSolveStep_;
+		float timeToCollision_;
+		size_t neighborsInRange_;
+		float neighborDensity_;
+		float neighborRangeSq_;
 		std::vector<std::pair<float, const Agent *> > agentNeighbors_;
 		std::vector<Plane> orcaPlanes_;
+		std::vector<PlaneState> planeStates_;
+		std::vector<const Agent *> neighborCandidates_;
+		std::vector<size_t> bindingNeighbors_;
+		Vector3 candidatePosition_;
 
         //bool debug_;
         bool valid_;
+        bool passive_;
+        SolvePath solvePath_;
+        bool budgetExceeded_;
 
-        int avoidanceGroup_;
-        int groupsToAvoid_;
-        int groupsToIgnore_;
-        TSet<int> agentsToIgnore_;
+        IgnoreList agentsToIgnore_;
 
 		friend class KdTree;
 		friend class RVOSimulator;
@@ -2,7 +2,22 @@
 #ifndef RVO_DEFINITIONS_H_
 #define RVO_DEFINITIONS_H_
 
+#include <cstring>
+
 namespace RVO {
+	/**
+	 * \brief   Returns whether a float is not a number. Tests the bit pattern, so that fast floating-point math cannot fold the test away.
+	 * \param   scalar  The float to be tested.
+	 * \return  True if the float is not a number.
+	 */
+	inline bool isNaN(float scalar)
+	{
+		unsigned int bits;
+		std::memcpy(&bits, &scalar, sizeof(bits));
+
+		return (bits & 0x7fffffffu) > 0x7f800000u;
+	}
+
 	/**
 	 * \brief   Computes the square of a float.
 	 * \param   scalar  The float to be squared.
@@ -0,0 +1,116 @@
+#include "Executor.h"
+
+#include <algorithm>
+
+namespace RVO {
+	ThreadPoolExecutor::ThreadPoolExecutor(size_t numThreads) : shares_(std::max<size_t>(numThreads > 0 ? numThreads : std::thread::hardware_concurrency(), 1)), body_(NULL), count_(0), chunkSize_(0), generation_(0), pendingWorkers_(0), stopping_(false)
+	{
+		for (size_t i = 1; i < shares_.size(); ++i) {
+			workers_.push_back(std::thread(&ThreadPoolExecutor::workerMain, this, i));
+		}
+	}
+
+	ThreadPoolExecutor::~ThreadPoolExecutor()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+
+		startCondition_.notify_all();
+
+		for (size_t i = 0; i < workers_.size(); ++i) {
+			workers_[i].join();
+		}
+	}
+
+	size_t ThreadPoolExecutor::getNumThreads() const
+	{
+		return shares_.size();
+	}
+
+	void ThreadPoolExecutor::parallelFor(size_t count, const std::function<void(size_t, size_t)> &body)
+	{
+		const size_t numThreads = shares_.size();
+
+		if (numThreads == 1 || count <= MinChunkSize) {
+			/* Not worth waking the workers. */
+			if (count > 0) {
+				body(0, count);
+			}
+
+			return;
+		}
+
+		const size_t chunkSize = std::max((count + numThreads * ChunksPerThread - 1) / (numThreads * ChunksPerThread), MinChunkSize);
+		const size_t numChunks = (count + chunkSize - 1) / chunkSize;
+
+		for (size_t i = 0; i < numThreads; ++i) {
+			shares_[i].next.store(i * numChunks / numThreads, std::memory_order_relaxed);
+			shares_[i].end = (i + 1) * numChunks / numThreads;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			body_ = &body;
+			count_ = count;
+			chunkSize_ = chunkSize;
+			pendingWorkers_ = workers_.size();
+			++generation_;
+		}
+
+		startCondition_.notify_all();
+		runChunks(0);
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		doneCondition_.wait(lock, [this]() { return pendingWorkers_ == 0; });
+		body_ = NULL;
+	}
+
+	void ThreadPoolExecutor::runChunks(size_t threadNo)
+	{
+		const size_t numThreads = shares_.size();
+
+		/* The own share first, then the shares of the following threads. Owner and thieves claim chunks from the same counter. */
+		for (size_t k = 0; k < numThreads; ++k) {
+			Share &share = shares_[(threadNo + k) % numThreads];
+
+			for (size_t chunk = share.next.fetch_add(1, std::memory_order_relaxed); chunk < share.end; chunk = share.next.fetch_add(1, std::memory_order_relaxed)) {
+				const size_t begin = chunk * chunkSize_;
+
+				(*body_)(begin, std::min(begin + chunkSize_, count_));
+			}
+		}
+	}
+
+	void ThreadPoolExecutor::workerMain(size_t threadNo)
+	{
+		size_t generation = 0;
+
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				startCondition_.wait(lock, [this, generation]() { return stopping_ || generation_ != generation; });
+
+				if (stopping_) {
+					return;
+				}
+
+				generation = generation_;
+			}
+
+			runChunks(threadNo);
+
+			bool done;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				done = --pendingWorkers_ == 0;
+			}
+
+			if (done) {
+				doneCondition_.notify_one();
+			}
+		}
+	}
+}
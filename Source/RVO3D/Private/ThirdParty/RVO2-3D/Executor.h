@@ -0,0 +1,124 @@
+#ifndef RVO_EXECUTOR_H_
+#define RVO_EXECUTOR_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RVO {
+	/**
+	 * \brief   Defines the interface through which the simulation runs its parallel loops.
+	 *
+	 * The simulation only hands loops whose iterations are independent to an executor, so an implementation may run them on any threads and in any order.
+	 */
+	class Executor {
+	public:
+		/**
+		 * \brief   Destroys this executor instance.
+		 */
+		virtual ~Executor() { }
+
+		/**
+		 * \brief   Returns the number of threads loops are spread over, including the calling thread.
+		 * \return  The number of threads.
+		 */
+		virtual size_t getNumThreads() const = 0;
+
+		/**
+		 * \brief   Runs a loop over a range of indices and returns once all iterations have completed. The body may not start another loop on the same executor.
+		 * \param   count  The number of iterations.
+		 * \param   body   The function called with disjoint ranges [begin, end) that together cover [0, count), possibly concurrently.
+		 */
+		virtual void parallelFor(size_t count, const std::function<void(size_t, size_t)> &body) = 0;
+	};
+
+	/**
+	 * \brief   Defines an executor that runs loops on the calling thread.
+	 */
+	class SerialExecutor : public Executor {
+	public:
+		virtual size_t getNumThreads() const { return 1; }
+
+		virtual void parallelFor(size_t count, const std::function<void(size_t, size_t)> &body)
+		{
+			if (count > 0) {
+				body(0, count);
+			}
+		}
+	};
+
+	/**
+	 * \brief   Defines an executor that runs loops on a pool of standard threads, for builds without an engine task system.
+	 *
+	 * A loop is cut into chunks, and each thread starts on its own contiguous share of them. Threads done with their share steal the remaining chunks of the others, so uneven iterations balance out without locks.
+	 */
+	class ThreadPoolExecutor : public Executor {
+	public:
+		/**
+		 * \brief   Constructs a thread pool executor instance and starts its worker threads.
+		 * \param   numThreads  The number of threads loops are spread over, including the calling thread. Zero for the number of hardware threads.
+		 */
+		explicit ThreadPoolExecutor(size_t numThreads = 0);
+
+		/**
+		 * \brief   Stops the worker threads and destroys this thread pool executor instance.
+		 */
+		virtual ~ThreadPoolExecutor();
+
+		virtual size_t getNumThreads() const;
+
+		virtual void parallelFor(size_t count, const std::function<void(size_t, size_t)> &body);
+
+	private:
+		/**
+		 * \brief   Defines the share of chunks of a thread. Aligned to a cache line so that threads claiming chunks do not contend on a shared line.
+		 */
+		struct alignas(64) Share {
+			std::atomic<size_t> next;
+			size_t end;
+		};
+
+		/**
+		 * \brief   The number of chunks per thread a loop is cut into.
+		 */
+		static const size_t ChunksPerThread = 8;
+
+		/**
+		 * \brief   The smallest number of iterations in a chunk.
+		 */
+		static const size_t MinChunkSize = 16;
+
+		ThreadPoolExecutor(const ThreadPoolExecutor &other);
+		ThreadPoolExecutor &operator=(const ThreadPoolExecutor &other);
+
+		/**
+		 * \brief   Runs the chunks of the current loop, starting with the share of a thread and then stealing from the others.
+		 * \param   threadNo  The number of the thread, zero for the calling thread.
+		 */
+		void runChunks(size_t threadNo);
+
+		/**
+		 * \brief   Waits for loops and runs their chunks until the executor is destroyed.
+		 * \param   threadNo  The number of the worker thread, from one.
+		 */
+		void workerMain(size_t threadNo);
+
+		std::vector<std::thread> workers_;
+		std::vector<Share> shares_;
+		const std::function<void(size_t, size_t)> *body_;
+		size_t count_;
+		size_t chunkSize_;
+		size_t generation_;
+		size_t pendingWorkers_;
+		bool stopping_;
+		std::mutex mutex_;
+		std::condition_variable startCondition_;
+		std::condition_variable doneCondition_;
+	};
+}
+
+#endif /* RVO_EXECUTOR_H_ */
@@ -0,0 +1,155 @@
+#ifndef RVO_IGNORE_LIST_H_
+#define RVO_IGNORE_LIST_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "Platform.h"
+
+namespace RVO {
+	/**
+	 * \brief   Defines the set of agent numbers an agent leaves out of its neighbors.
+	 *
+	 * Most agents ignore no agent or only a few, so short lists are kept sorted in place and searched linearly. Longer lists move to a sorted array that is searched by bisection. Agent numbers are unique but unbounded, so a bitset does not fit them.
+	 */
+	class IgnoreList {
+	public:
+		/**
+		 * \brief   Constructs an empty ignore list.
+		 */
+		IgnoreList() : size_(0) { }
+
+		/**
+		 * \brief   Returns whether the ignore list is empty.
+		 * \return  True if no agent is ignored.
+		 */
+		FORCEINLINE bool isEmpty() const { return size_ == 0; }
+
+		/**
+		 * \brief   Returns the number of ignored agents.
+		 * \return  The number of agent numbers in the ignore list.
+		 */
+		FORCEINLINE size_t size() const { return size_; }
+
+		/**
+		 * \brief   Returns whether an agent is ignored.
+		 * \param   agentNo  The number of the agent.
+		 * \return  True if the agent number is in the ignore list.
+		 */
+		FORCEINLINE bool contains(size_t agentNo) const
+		{
+			if (size_ == 0) {
+				return false;
+			}
+
+			if (size_ <= InlineCapacity) {
+				for (size_t i = 0; i < size_ && inline_[i] <= agentNo; ++i) {
+					if (inline_[i] == agentNo) {
+						return true;
+					}
+				}
+
+				return false;
+			}
+
+			return std::binary_search(overflow_.begin(), overflow_.end(), agentNo);
+		}
+
+		/**
+		 * \brief   Adds an agent to the ignore list, if not present.
+		 * \param   agentNo  The number of the agent to be ignored.
+		 */
+		void add(size_t agentNo)
+		{
+			if (!contains(agentNo)) {
+				std::vector<size_t> agentNos(begin(), end());
+				agentNos.insert(std::upper_bound(agentNos.begin(), agentNos.end(), agentNo), agentNo);
+				assign(agentNos);
+			}
+		}
+
+		/**
+		 * \brief   Adds several agents to the ignore list. Agents already present are left unchanged.
+		 * \param   agentNos  A pointer to the numbers of the agents to be ignored.
+		 * \param   count     The number of agents to be ignored.
+		 */
+		template <class T>
+		void add(const T *agentNos, size_t count)
+		{
+			std::vector<size_t> merged(begin(), end());
+			merged.insert(merged.end(), agentNos, agentNos + count);
+			std::sort(merged.begin(), merged.end());
+			merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+			assign(merged);
+		}
+
+		/**
+		 * \brief   Removes an agent from the ignore list, if present.
+		 * \param   agentNo  The number of the agent no longer to be ignored.
+		 */
+		void remove(size_t agentNo)
+		{
+			if (contains(agentNo)) {
+				std::vector<size_t> agentNos(begin(), end());
+				agentNos.erase(std::lower_bound(agentNos.begin(), agentNos.end(), agentNo));
+				assign(agentNos);
+			}
+		}
+
+		/**
+		 * \brief   Removes all agents from the ignore list.
+		 * \param   shrink  True to release the memory of a long list.
+		 */
+		void clear(bool shrink = false)
+		{
+			size_ = 0;
+			overflow_.clear();
+
+			if (shrink) {
+				std::vector<size_t>().swap(overflow_);
+			}
+		}
+
+	private:
+		/**
+		 * \brief   The number of agents kept in place.
+		 */
+		static const size_t InlineCapacity = 8;
+
+		/**
+		 * \brief   Returns the first of the sorted agent numbers.
+		 * \return  A pointer to the smallest agent number.
+		 */
+		const size_t *begin() const { return size_ <= InlineCapacity ? inline_ : overflow_.data(); }
+
+		/**
+		 * \brief   Returns one past the last of the sorted agent numbers.
+		 * \return  A pointer past the largest agent number.
+		 */
+		const size_t *end() const { return begin() + size_; }
+
+		/**
+		 * \brief   Replaces the agent numbers of the ignore list.
+		 * \param   agentNos  The sorted agent numbers, without duplicates.
+		 */
+		void assign(const std::vector<size_t> &agentNos)
+		{
+			size_ = agentNos.size();
+
+			if (size_ <= InlineCapacity) {
+				std::copy(agentNos.begin(), agentNos.end(), inline_);
+				overflow_.clear();
+			}
+			else {
+				overflow_ = agentNos;
+			}
+		}
+
+		size_t inline_[InlineCapacity];
+		std::vector<size_t> overflow_;
+		size_t size_;
+	};
+}
+
+#endif /* RVO_IGNORE_LIST_H_ */
@@ -8,37 +8,40 @@
 #include "RVOSimulator.h"
 
 namespace RVO {
-	const size_t RVO_MAX_LEAF_SIZE = 10;
-
 	KdTree::KdTree(RVOSimulator *sim) : sim_(sim) { }
 
+	template <class Traits>
 	void KdTree::buildAgentTree()
 	{
 		agents_ = sim_->agents_;
 
 		if (!agents_.empty()) {
 			agentTree_.resize(2 * agents_.size() - 1);
-			buildAgentTreeRecursive(0, agents_.size(), 0);
+			buildAgentTreeRecursive<Traits>(0, agents_.size(), 0);
 		}
 	}
 
+	template <class Traits>
 	void KdTree::buildAgentTreeRecursive(size_t begin, size_t end, size_t node)
 	{
 		agentTree_[node].begin = begin;
 		agentTree_[node].end = end;
-		agentTree_[node].minCoord = agents_[begin]->position_;
-		agentTree_[node].maxCoord = agents_[begin]->position_;
+
+		const size_t state = sim_->stateIndex_;
+
+		agentTree_[node].minCoord = agents_[begin]->positions_[state];
+		agentTree_[node].maxCoord = agents_[begin]->positions_[state];
 
 		for (size_t i = begin + 1; i < end; ++i) {
-			agentTree_[node].maxCoord[0] = std::max(agentTree_[node].maxCoord[0], agents_[i]->position_.x());
-			agentTree_[node].minCoord[0] = std::min(agentTree_[node].minCoord[0], agents_[i]->position_.x());
-			agentTree_[node].maxCoord[1] = std::max(agentTree_[node].maxCoord[1], agents_[i]->position_.y());
-			agentTree_[node].minCoord[1] = std::min(agentTree_[node].minCoord[1], agents_[i]->position_.y());
-			agentTree_[node].maxCoord[2] = std::max(agentTree_[node].maxCoord[2], agents_[i]->position_.z());
-			agentTree_[node].minCoord[2] = std::min(agentTree_[node].minCoord[2], agents_[i]->position_.z());
+			agentTree_[node].maxCoord[0] = std::max(agentTree_[node].maxCoord[0], agents_[i]->positions_[state].x());
+			agentTree_[node].minCoord[0] = std::min(agentTree_[node].minCoord[0], agents_[i]->positions_[state].x());
+			agentTree_[node].maxCoord[1] = std::max(agentTree_[node].maxCoord[1], agents_[i]->positions_[state].y());
+			agentTree_[node].minCoord[1] = std::min(agentTree_[node].minCoord[1], agents_[i]->positions_[state].y());
+			agentTree_[node].maxCoord[2] = std::max(agentTree_[node].maxCoord[2], agents_[i]->positions_[state].z());
+			agentTree_[node].minCoord[2] = std::min(agentTree_[node].minCoord[2], agents_[i]->positions_[state].z());
 		}
 
-		if (end - begin > RVO_MAX_LEAF_SIZE) {
+		if (end - begin > Traits::MaxLeafSize) {
 			/* No leaf node. */
 			size_t coord;
 
@@ -59,11 +62,11 @@ namespace RVO {
 			size_t right = end;
 
 			while (left < right) {
-				while (left < right && agents_[left]->position_[coord] < splitValue) {
+				while (left < right && agents_[left]->positions_[state][coord] < splitValue) {
 					++left;
 				}
 
-				while (right > left && agents_[right - 1]->position_[coord] >= splitValue) {
+				while (right > left && agents_[right - 1]->positions_[state][coord] >= splitValue) {
 					--right;
 				}
 
@@ -85,46 +88,197 @@ namespace RVO {
 			agentTree_[node].left = node + 1;
 			agentTree_[node].right = node + 2 * leftSize;
 
-			buildAgentTreeRecursive(begin, left, agentTree_[node].left);
-			buildAgentTreeRecursive(left, end, agentTree_[node].right);
+			buildAgentTreeRecursive<Traits>(begin, left, agentTree_[node].left);
+			buildAgentTreeRecursive<Traits>(left, end, agentTree_[node].right);
 		}
 	}
 
+	template <class Traits>
 	void KdTree::computeAgentNeighbors(Agent *agent, float rangeSq) const
 	{
-		queryAgentTreeRecursive(agent, rangeSq, 0);
+		queryAgentTreeRecursive<Traits>(agent, rangeSq, 0);
 	}
 
+	template <class Traits>
 	void KdTree::queryAgentTreeRecursive(Agent *agent, float &rangeSq, size_t node) const
 	{
-		if (agentTree_[node].end - agentTree_[node].begin <= RVO_MAX_LEAF_SIZE) {
+		if (agentTree_[node].end - agentTree_[node].begin <= Traits::MaxLeafSize) {
 			for (size_t i = agentTree_[node].begin; i < agentTree_[node].end; ++i) {
-				agent->insertAgentNeighbor(agents_[i], rangeSq);
+				agent->insertAgentNeighbor<Traits>(agents_[i], rangeSq);
 			}
 		}
 		else {
-			const float distSqLeft = sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[0] - agent->position_.x())) + sqr(std::max(0.0f, agent->position_.x() - agentTree_[agentTree_[node].left].maxCoord[0])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[1] - agent->position_.y())) + sqr(std::max(0.0f, agent->position_.y() - agentTree_[agentTree_[node].left].maxCoord[1])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[2] - agent->position_.z())) + sqr(std::max(0.0f, agent->position_.z() - agentTree_[agentTree_[node].left].maxCoord[2]));
+			const Vector3 &position = agent->position();
 
-			const float distSqRight = sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[0] - agent->position_.x())) + sqr(std::max(0.0f, agent->position_.x() - agentTree_[agentTree_[node].right].maxCoord[0])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[1] - agent->position_.y())) + sqr(std::max(0.0f, agent->position_.y() - agentTree_[agentTree_[node].right].maxCoord[1])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[2] - agent->position_.z())) + sqr(std::max(0.0f, agent->position_.z() - agentTree_[agentTree_[node].right].maxCoord[2]));
+			const float distSqLeft = sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[0] - position.x())) + sqr(std::max(0.0f, position.x() - agentTree_[agentTree_[node].left].maxCoord[0])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[1] - position.y())) + sqr(std::max(0.0f, position.y() - agentTree_[agentTree_[node].left].maxCoord[1])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[2] - position.z())) + sqr(std::max(0.0f, position.z() - agentTree_[agentTree_[node].left].maxCoord[2]));
+
+			const float distSqRight = sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[0] - position.x())) + sqr(std::max(0.0f, position.x() - agentTree_[agentTree_[node].right].maxCoord[0])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[1] - position.y())) + sqr(std::max(0.0f, position.y() - agentTree_[agentTree_[node].right].maxCoord[1])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[2] - position.z())) + sqr(std::max(0.0f, position.z() - agentTree_[agentTree_[node].right].maxCoord[2]));
 
 			if (distSqLeft < distSqRight) {
 				if (distSqLeft < rangeSq) {
-					queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].left);
+					queryAgentTreeRecursive<Traits>(agent, rangeSq, agentTree_[node].left);
 
 					if (distSqRight < rangeSq) {
-						queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].right);
+						queryAgentTreeRecursive<Traits>(agent, rangeSq, agentTree_[node].right);
 					}
 				}
 			}
 			else {
 				if (distSqRight < rangeSq) {
-					queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].right);
+					queryAgentTreeRecursive<Traits>(agent, rangeSq, agentTree_[node].right);
 
 					if (distSqLeft < rangeSq) {
-						queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].left);
+						queryAgentTreeRecursive<Traits>(agent, rangeSq, agentTree_[node].left);
 					}
 				}
 			}
 		}
 	}
+
+	template <class Traits>
+	void KdTree::computeAgentNeighborCandidates(Agent *agent, float rangeSq) const
+	{
+		queryAgentCandidatesRecursive<Traits>(agent, rangeSq, 0);
+	}
+
+	template <class Traits>
+	void KdTree::queryAgentCandidatesRecursive(Agent *agent, float rangeSq, size_t node) const
+	{
+		if (agentTree_[node].end - agentTree_[node].begin <= Traits::MaxLeafSize) {
+			for (size_t i = agentTree_[node].begin; i < agentTree_[node].end; ++i) {
+				agent->insertNeighborCandidate(agents_[i], rangeSq);
+			}
+		}
+		else {
+			const Vector3 &position = agent->position();
+
+			const float distSqLeft = sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[0] - position.x())) + sqr(std::max(0.0f, position.x() - agentTree_[agentTree_[node].left].maxCoord[0])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[1] - position.y())) + sqr(std::max(0.0f, position.y() - agentTree_[agentTree_[node].left].maxCoord[1])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[2] - position.z())) + sqr(std::max(0.0f, position.z() - agentTree_[agentTree_[node].left].maxCoord[2]));
+
+			const float distSqRight = sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[0] - position.x())) + sqr(std::max(0.0f, position.x() - agentTree_[agentTree_[node].right].maxCoord[0])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[1] - position.y())) + sqr(std::max(0.0f, position.y() - agentTree_[agentTree_[node].right].maxCoord[1])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[2] - position.z())) + sqr(std::max(0.0f, position.z() - agentTree_[agentTree_[node].right].maxCoord[2]));
+
+			/* The range is fixed, so the traversal order does not matter. */
+			if (distSqLeft < rangeSq) {
+				queryAgentCandidatesRecursive<Traits>(agent, rangeSq, agentTree_[node].left);
+			}
+
+			if (distSqRight < rangeSq) {
+				queryAgentCandidatesRecursive<Traits>(agent, rangeSq, agentTree_[node].right);
+			}
+		}
+	}
+
+	template <class Traits>
+	void KdTree::computeAllAgentNeighbors(bool candidates) const
+	{
+		float maxRangeSq = 0.0f;
+
+		for (size_t i = 0; i < agents_.size(); ++i) {
+			Agent *const agent = agents_[i];
+			const float range = candidates ? agent->archetype_->neighborDist + sim_->neighborSkin_ : agent->archetype_->neighborDist;
+
+			/* Passive agents are found by others, but collect no neighbors of their own. */
+			agent->neighborRangeSq_ = agent->archetype_->maxNeighbors > 0 && !agent->passive_ ? sqr(range) : 0.0f;
+			maxRangeSq = std::max(maxRangeSq, agent->neighborRangeSq_);
+
+			if (candidates) {
+				agent->neighborCandidates_.clear();
+				agent->candidatePosition_ = agent->position();
+			}
+			else {
+				agent->agentNeighbors_.clear();
+				agent->neighborsInRange_ = 0;
+			}
+		}
+
+		if (!agents_.empty()) {
+			queryAgentPairsRecursive<Traits>(0, 0, maxRangeSq, candidates);
+		}
+	}
+
+	template <class Traits>
+	void KdTree::queryAgentPairsRecursive(size_t node1, size_t node2, float rangeSq, bool candidates) const
+	{
+		const AgentTreeNode &treeNode1 = agentTree_[node1];
+		const AgentTreeNode &treeNode2 = agentTree_[node2];
+
+		if (node1 != node2) {
+			/* Squared distance between the bounding boxes of both nodes. */
+			const float distSq = sqr(std::max(0.0f, std::max(treeNode1.minCoord[0] - treeNode2.maxCoord[0], treeNode2.minCoord[0] - treeNode1.maxCoord[0]))) + sqr(std::max(0.0f, std::max(treeNode1.minCoord[1] - treeNode2.maxCoord[1], treeNode2.minCoord[1] - treeNode1.maxCoord[1]))) + sqr(std::max(0.0f, std::max(treeNode1.minCoord[2] - treeNode2.maxCoord[2], treeNode2.minCoord[2] - treeNode1.maxCoord[2])));
+
+			if (distSq >= rangeSq) {
+				return;
+			}
+		}
+
+		const bool isLeaf1 = treeNode1.end - treeNode1.begin <= Traits::MaxLeafSize;
+		const bool isLeaf2 = treeNode2.end - treeNode2.begin <= Traits::MaxLeafSize;
+
+		if (isLeaf1 && isLeaf2) {
+			if (node1 == node2) {
+				for (size_t i = treeNode1.begin; i < treeNode1.end; ++i) {
+					for (size_t j = i + 1; j < treeNode1.end; ++j) {
+						insertAgentPair<Traits>(agents_[i], agents_[j], candidates);
+					}
+				}
+			}
+			else {
+				for (size_t i = treeNode1.begin; i < treeNode1.end; ++i) {
+					for (size_t j = treeNode2.begin; j < treeNode2.end; ++j) {
+						insertAgentPair<Traits>(agents_[i], agents_[j], candidates);
+					}
+				}
+			}
+		}
+		else if (node1 == node2) {
+			/* Each unordered pair of children is visited once. */
+			queryAgentPairsRecursive<Traits>(treeNode1.left, treeNode1.left, rangeSq, candidates);
+			queryAgentPairsRecursive<Traits>(treeNode1.left, treeNode1.right, rangeSq, candidates);
+			queryAgentPairsRecursive<Traits>(treeNode1.right, treeNode1.right, rangeSq, candidates);
+		}
+		else if (isLeaf1 || (!isLeaf2 && treeNode1.end - treeNode1.begin < treeNode2.end - treeNode2.begin)) {
+			/* Split the larger node. */
+			queryAgentPairsRecursive<Traits>(node1, treeNode2.left, rangeSq, candidates);
+			queryAgentPairsRecursive<Traits>(node1, treeNode2.right, rangeSq, candidates);
+		}
+		else {
+			queryAgentPairsRecursive<Traits>(treeNode1.left, node2, rangeSq, candidates);
+			queryAgentPairsRecursive<Traits>(treeNode1.right, node2, rangeSq, candidates);
+		}
+	}
+
+	template <class Traits>
+	void KdTree::insertAgentPair(Agent *agent1, Agent *agent2, bool candidates) const
+	{
+		const size_t state = sim_->stateIndex_;
+		const float distSq = absSq(agent1->positions_[state] - agent2->positions_[state]);
+
+		if (candidates) {
+			if (distSq < agent1->neighborRangeSq_) {
+				agent1->neighborCandidates_.push_back(agent2);
+			}
+
+			if (distSq < agent2->neighborRangeSq_) {
+				agent2->neighborCandidates_.push_back(agent1);
+			}
+		}
+		else {
+			if (!agent1->shouldIgnoreAgent<Traits>(agent2)) {
+				agent1->insertAgentNeighbor<Traits>(agent2, distSq, agent1->neighborRangeSq_);
+			}
+
+			if (!agent2->shouldIgnoreAgent<Traits>(agent1)) {
+				agent2->insertAgentNeighbor<Traits>(agent1, distSq, agent2->neighborRangeSq_);
+			}
+		}
+	}
+
+#define RVO_INSTANTIATE_KD_TREE(Traits) \
+	template void KdTree::buildAgentTree<Traits>(); \
+	template void KdTree::computeAgentNeighbors<Traits>(Agent *agent, float rangeSq) const; \
+	template void KdTree::computeAgentNeighborCandidates<Traits>(Agent *agent, float rangeSq) const; \
+	template void KdTree::computeAllAgentNeighbors<Traits>(bool candidates) const;
+
+	RVO_SIMULATOR_TRAITS(RVO_INSTANTIATE_KD_TREE)
+
+#undef RVO_INSTANTIATE_KD_TREE
 }
@@ -60,9 +60,12 @@ namespace RVO {
 
 		/**
 		 * \brief   Builds an agent <i>k</i>d-tree.
+		 * \tparam  Traits  The compile-time configuration of the simulation, providing the maximum leaf size.
 		 */
+		template <class Traits>
 		void buildAgentTree();
 
+		template <class Traits>
 		void buildAgentTreeRecursive(size_t begin, size_t end, size_t node);
 
 		/**
@@ -70,10 +73,42 @@ namespace RVO {
 		 * \param   agent    A pointer to the agent for which agent neighbors are to be computed.
 		 * \param   rangeSq  The squared range around the agent.
 		 */
+		template <class Traits>
 		void computeAgentNeighbors(Agent *agent, float rangeSq) const;
 
+		template <class Traits>
 		void queryAgentTreeRecursive(Agent *agent, float &rangeSq, size_t node) const;
 
+		/**
+		 * \brief   Computes all agents within a fixed range of the specified agent as its cached neighbor candidates.
+		 * \param   agent    A pointer to the agent for which neighbor candidates are to be computed.
+		 * \param   rangeSq  The squared range around the agent.
+		 */
+		template <class Traits>
+		void computeAgentNeighborCandidates(Agent *agent, float rangeSq) const;
+
+		template <class Traits>
+		void queryAgentCandidatesRecursive(Agent *agent, float rangeSq, size_t node) const;
+
+		/**
+		 * \brief   Computes the agent neighbors of all agents in a single traversal of the <i>k</i>d-tree against itself.
+		 * \param   candidates  True if the cached neighbor candidates are to be computed instead of the agent neighbors.
+		 */
+		template <class Traits>
+		void computeAllAgentNeighbors(bool candidates) const;
+
+		template <class Traits>
+		void queryAgentPairsRecursive(size_t node1, size_t node2, float rangeSq, bool candidates) const;
+
+		/**
+		 * \brief   Inserts two agents into each other's agent neighbors or neighbor candidates.
+		 * \param   agent1      A pointer to the first agent.
+		 * \param   agent2      A pointer to the second agent.
+		 * \param   candidates  True if the agents are to be inserted into each other's neighbor candidates.
+		 */
+		template <class Traits>
+		void insertAgentPair(Agent *agent1, Agent *agent2, bool candidates) const;
+
 		std::vector<Agent *> agents_;
 		std::vector<AgentTreeNode> agentTree_;
 		RVOSimulator *sim_;
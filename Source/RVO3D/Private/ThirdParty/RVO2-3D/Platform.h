@@ -0,0 +1,11 @@
+#ifndef RVO_PLATFORM_H_
+#define RVO_PLATFORM_H_
+
+/**
+ * \brief   Marks the accessors of the simulation for inlining. Inside the engine the engine's definition applies. Elsewhere it is empty, as most of the marked accessors are defined out of line in RVOSimulator.cpp.
+ */
+#ifndef FORCEINLINE
+#define FORCEINLINE
+#endif
+
+#endif /* RVO_PLATFORM_H_ */
@@ -2,6 +2,7 @@
 #ifndef RVO_RVO_H_
 #define RVO_RVO_H_
 
+#include "Executor.h"
 #include "RVOSimulator.h"
 #include "Vector3.h"
 
@@ -1,30 +1,34 @@
 
 #include "RVOSimulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
 #include "Agent.h"
+#include "Definitions.h"
+#include "Executor.h"
 #include "KdTree.h"
 
 namespace RVO {
-	RVOSimulator::RVOSimulator() : defaultAgent_(NULL), kdTree_(NULL), globalTime_(0.0f), timeStep_(0.0f)
+	RVOSimulator::RVOSimulator() : defaultAgent_(NULL), kdTree_(NULL), globalTime_(0.0f), timeStep_(0.0f), maxORCAPlanes_(0), maxSolverIterations_(0), neighborSkin_(0.0f), dualTreeNeighbors_(false), sharedORCAPlanes_(false), velocityPruning_(false), adaptiveNeighbors_(false), warmStartedSolve_(false), adaptiveNeighborSmoothing_(0.25f), adaptiveNeighborHeadroom_(1.5f), velocityPruningMargin_(0.0f), neighborCandidatesDirty_(true), stateIndex_(0), stepCount_(0), solveTimeBudget_(0.0f), solveCursor_(0), maxSolvedAgents_(0), urgencyScheduling_(false), maxDeferredSteps_(8), executor_(NULL), timedPhases_(false)
 	{
 		kdTree_ = new KdTree(this);
 	}
 
-	RVOSimulator::RVOSimulator(float timeStep, float neighborDist, size_t maxNeighbors, float timeHorizon, float radius, float maxSpeed, const Vector3 &velocity) : defaultAgent_(NULL), kdTree_(NULL), globalTime_(0.0f), timeStep_(timeStep)
+	RVOSimulator::RVOSimulator(float timeStep, float neighborDist, size_t maxNeighbors, float timeHorizon, float radius, float maxSpeed, const Vector3 &velocity) : defaultAgent_(NULL), kdTree_(NULL), globalTime_(0.0f), timeStep_(timeStep), maxORCAPlanes_(0), maxSolverIterations_(0), neighborSkin_(0.0f), dualTreeNeighbors_(false), sharedORCAPlanes_(false), velocityPruning_(false), adaptiveNeighbors_(false), warmStartedSolve_(false), adaptiveNeighborSmoothing_(0.25f), adaptiveNeighborHeadroom_(1.5f), velocityPruningMargin_(0.0f), neighborCandidatesDirty_(true), stateIndex_(0), stepCount_(0), solveTimeBudget_(0.0f), solveCursor_(0), maxSolvedAgents_(0), urgencyScheduling_(false), maxDeferredSteps_(8), executor_(NULL), timedPhases_(false)
 	{
 		kdTree_ = new KdTree(this);
 		defaultAgent_ = new Agent(this);
 
-		defaultAgent_->maxNeighbors_ = maxNeighbors;
-		defaultAgent_->maxSpeed_ = maxSpeed;
-		defaultAgent_->neighborDist_ = neighborDist;
-		defaultAgent_->radius_ = radius;
-		defaultAgent_->timeHorizon_ = timeHorizon;
-		defaultAgent_->velocity_ = velocity;
+		assignArchetype(defaultAgent_, acquireArchetype(AgentArchetype(neighborDist, maxNeighbors, timeHorizon, radius, maxSpeed)));
+		defaultAgent_->velocity() = velocity;
 	}
 
 	RVOSimulator::~RVOSimulator()
 	{
-        agentMap_.Empty();
+        agentMap_.clear();
 
 		if (defaultAgent_ != NULL) {
 			delete defaultAgent_;
@@ -41,38 +45,45 @@ namespace RVO {
 
 	bool RVOSimulator::hasAgent(size_t agentNo) const
 	{
-		return agentMap_.Contains(agentNo);
+		return agentMap_.find(agentNo) != agentMap_.end();
 	}
 
 	size_t RVOSimulator::getAgentNumNeighbors(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->agentNeighbors_.size();
+		return findAgent(agentNo)->agentNeighbors_.size();
 	}
 
 	size_t RVOSimulator::getAgentNeighbour(size_t agentNo, size_t neighborNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->agentNeighbors_[neighborNo].second->id_;
+		return findAgent(agentNo)->agentNeighbors_[neighborNo].second->id_;
 	}
 
 	size_t RVOSimulator::getAgentNumORCAPlanes(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->orcaPlanes_.size();
+		return findAgent(agentNo)->orcaPlanes_.size();
 	}
 
 	const Plane &RVOSimulator::getAgentORCAPlane(size_t agentNo, size_t planeNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->orcaPlanes_[planeNo];
+		return findAgent(agentNo)->orcaPlanes_[planeNo];
 	}
 
 	void RVOSimulator::removeAgent(size_t agentNo)
 	{
-        // Delete agent
-		delete agents_[agentNo];
-        // RemoveAtSwap()
-		agents_[agentNo] = agents_.back();
+		Agent *agent = findAgent(agentNo);
+
+        // RemoveAtSwap(), agentNo is an id and not an index into agents_
+		*std::find(agents_.begin(), agents_.end(), agent) = agents_.back();
 		agents_.pop_back();
+
         // Remove agentMap_ entry
-        agentMap_.Remove(agentNo);
+        agentMap_.erase(agentNo);
+        // Release the parameters before deleting the agent
+		releaseArchetype(agent->archetypeNo_);
+		delete agent;
+
+        // Cached candidates may point to the deleted agent
+        neighborCandidatesDirty_ = true;
 	}
 
 	size_t RVOSimulator::addAgent(const Vector3 &position)
@@ -84,21 +95,17 @@ namespace RVO {
 		Agent *agent = new Agent(this);
         size_t agentID = agentUID_++;
 
-		agent->position_ = position;
-		agent->maxNeighbors_ = defaultAgent_->maxNeighbors_;
-		agent->maxSpeed_ = defaultAgent_->maxSpeed_;
-		agent->neighborDist_ = defaultAgent_->neighborDist_;
-		agent->radius_ = defaultAgent_->radius_;
-		agent->timeHorizon_ = defaultAgent_->timeHorizon_;
-		agent->avoidanceGroup_ = defaultAgent_->avoidanceGroup_;
-		agent->groupsToAvoid_ = defaultAgent_->groupsToAvoid_;
-		agent->groupsToIgnore_ = defaultAgent_->groupsToIgnore_;
-		agent->velocity_ = defaultAgent_->velocity_;
+		agent->position() = position;
+		assignArchetype(agent, defaultAgent_->archetypeNo_);
+		agent->velocity() = defaultAgent_->velocity();
+		agent->newVelocity_ = agent->velocity();
+		agent->resetNeighborBudget();
 
 		agent->id_ = agentID;
 
 		agents_.push_back(agent);
-		agentMap_.Emplace(agentID, agent);
+		agentMap_[agentID] = agent;
+		neighborCandidatesDirty_ = true;
 
 		return agentID;
 	}
@@ -108,84 +115,575 @@ namespace RVO {
 		Agent *agent = new Agent(this);
         size_t agentID = agentUID_++;
 
-		agent->position_ = position;
-		agent->maxNeighbors_ = maxNeighbors;
-		agent->maxSpeed_ = maxSpeed;
-		agent->neighborDist_ = neighborDist;
-		agent->radius_ = radius;
-		agent->timeHorizon_ = timeHorizon;
-		agent->avoidanceGroup_ = avoidanceGroup;
-		agent->groupsToAvoid_ = groupsToAvoid;
-		agent->groupsToIgnore_ = groupsToIgnore;
-		agent->velocity_ = velocity;
+		agent->position() = position;
+		assignArchetype(agent, acquireArchetype(AgentArchetype(neighborDist, maxNeighbors, timeHorizon, radius, maxSpeed, avoidanceGroup, groupsToAvoid, groupsToIgnore)));
+		agent->velocity() = velocity;
+		agent->newVelocity_ = velocity;
+		agent->resetNeighborBudget();
+
+		agent->id_ = agentID;
+
+		agents_.push_back(agent);
+		agentMap_[agentID] = agent;
+		neighborCandidatesDirty_ = true;
+
+		return agentID;
+	}
+
+	size_t RVOSimulator::addAgent(const Vector3 &position, size_t archetypeNo, const Vector3 &velocity)
+	{
+		if (archetypeNo >= archetypes_.size() || archetypes_[archetypeNo].isPrivate || archetypes_[archetypeNo].isFree) {
+			return RVO_ERROR;
+		}
+
+		Agent *agent = new Agent(this);
+        size_t agentID = agentUID_++;
+
+		agent->position() = position;
+		assignArchetype(agent, archetypeNo);
+		agent->velocity() = velocity;
+		agent->newVelocity_ = velocity;
+		agent->resetNeighborBudget();
 
 		agent->id_ = agentID;
 
 		agents_.push_back(agent);
-		agentMap_.Emplace(agentID, agent);
+		agentMap_[agentID] = agent;
+		neighborCandidatesDirty_ = true;
 
 		return agentID;
 	}
 
+	size_t RVOSimulator::addArchetype(const AgentArchetype &archetype)
+	{
+		ArchetypeEntry entry;
+		entry.archetype = archetype;
+		entry.refCount = 0;
+		entry.isPrivate = false;
+		entry.isPinned = true;
+		entry.isFree = false;
+
+		return insertArchetype(entry);
+	}
+
+	size_t RVOSimulator::findArchetype(const AgentArchetype &archetype) const
+	{
+		/* Only shared archetypes in use are indexed. */
+		typedef std::unordered_multimap<size_t, size_t>::const_iterator Iterator;
+		const std::pair<Iterator, Iterator> range = archetypeIndex_.equal_range(hashArchetype(archetype));
+
+		for (Iterator iterator = range.first; iterator != range.second; ++iterator) {
+			if (archetypes_[iterator->second].archetype == archetype) {
+				return iterator->second;
+			}
+		}
+
+		return RVO_ERROR;
+	}
+
+	size_t RVOSimulator::acquireArchetype(const AgentArchetype &archetype)
+	{
+		const size_t archetypeNo = findArchetype(archetype);
+
+		if (archetypeNo != RVO_ERROR) {
+			return archetypeNo;
+		}
+
+		ArchetypeEntry entry;
+		entry.archetype = archetype;
+		entry.refCount = 0;
+		entry.isPrivate = false;
+		entry.isPinned = false;
+		entry.isFree = false;
+
+		return insertArchetype(entry);
+	}
+
+	size_t RVOSimulator::hashArchetype(const AgentArchetype &archetype)
+	{
+		size_t hash = std::hash<size_t>()(archetype.maxNeighbors);
+		const float values[] = { archetype.maxSpeed, archetype.neighborDist, archetype.radius, archetype.timeHorizon };
+		const int masks[] = { archetype.avoidanceGroup, archetype.groupsToAvoid, archetype.groupsToIgnore };
+
+		for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+			hash ^= std::hash<float>()(values[i]) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+		}
+
+		for (size_t i = 0; i < sizeof(masks) / sizeof(masks[0]); ++i) {
+			hash ^= std::hash<int>()(masks[i]) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+		}
+
+		return hash;
+	}
+
+	size_t RVOSimulator::insertArchetype(const ArchetypeEntry &entry)
+	{
+		size_t archetypeNo;
+
+		if (!freeArchetypes_.empty()) {
+			archetypeNo = freeArchetypes_.back();
+			freeArchetypes_.pop_back();
+			archetypes_[archetypeNo] = entry;
+		}
+		else {
+			archetypes_.push_back(entry);
+			archetypeNo = archetypes_.size() - 1;
+		}
+
+		if (!entry.isPrivate) {
+			archetypeIndex_.insert(std::make_pair(hashArchetype(entry.archetype), archetypeNo));
+		}
+
+		return archetypeNo;
+	}
+
+	void RVOSimulator::unindexArchetype(size_t archetypeNo)
+	{
+		typedef std::unordered_multimap<size_t, size_t>::iterator Iterator;
+		const std::pair<Iterator, Iterator> range = archetypeIndex_.equal_range(hashArchetype(archetypes_[archetypeNo].archetype));
+
+		for (Iterator iterator = range.first; iterator != range.second; ++iterator) {
+			if (iterator->second == archetypeNo) {
+				archetypeIndex_.erase(iterator);
+				return;
+			}
+		}
+	}
+
+	void RVOSimulator::assignArchetype(Agent *agent, size_t archetypeNo)
+	{
+		++archetypes_[archetypeNo].refCount;
+
+		if (agent->archetype_ != NULL) {
+			releaseArchetype(agent->archetypeNo_);
+		}
+
+		agent->archetype_ = &archetypes_[archetypeNo].archetype;
+		agent->archetypeNo_ = archetypeNo;
+	}
+
+	void RVOSimulator::releaseArchetype(size_t archetypeNo)
+	{
+		ArchetypeEntry &entry = archetypes_[archetypeNo];
+
+		if (--entry.refCount == 0 && !entry.isPinned) {
+			if (!entry.isPrivate) {
+				unindexArchetype(archetypeNo);
+			}
+
+			entry.isFree = true;
+			freeArchetypes_.push_back(archetypeNo);
+		}
+	}
+
+	AgentArchetype &RVOSimulator::overrideArchetype(Agent *agent)
+	{
+		if (archetypes_[agent->archetypeNo_].isPrivate) {
+			return archetypes_[agent->archetypeNo_].archetype;
+		}
+
+		ArchetypeEntry entry;
+		entry.archetype = *agent->archetype_;
+		entry.refCount = 0;
+		entry.isPrivate = true;
+		entry.isPinned = false;
+		entry.isFree = false;
+
+		const size_t archetypeNo = insertArchetype(entry);
+
+		assignArchetype(agent, archetypeNo);
+
+		return archetypes_[archetypeNo].archetype;
+	}
+
+	void RVOSimulator::doStep()
+	{
+		doStep<DefaultSimulatorTraits>();
+	}
+
+	void RVOSimulator::shiftOrigin(const Vector3 &offset)
+	{
+		/* Relative positions are unchanged, so cached neighbor candidates stay valid. */
+		for (size_t i = 0; i < agents_.size(); ++i) {
+			agents_[i]->position() -= offset;
+			agents_[i]->candidatePosition_ -= offset;
+		}
+	}
+
+	template <class Traits>
 	void RVOSimulator::doStep()
 	{
-		kdTree_->buildAgentTree();
+		std::chrono::steady_clock::time_point phaseStart = std::chrono::steady_clock::now();
+		bool computedNeighbors = false;
+
+		phaseTimings_ = PhaseTimings();
+
+		if (neighborSkin_ > 0.0f) {
+			if (neighborCandidatesDirty_ || shouldComputeNeighborCandidates()) {
+				kdTree_->buildAgentTree<Traits>();
+				endPhase(phaseTimings_.buildTree, phaseStart);
+
+				if (dualTreeNeighbors_) {
+					kdTree_->computeAllAgentNeighbors<Traits>(true);
+				}
+				else {
+					forEachAgent([](Agent *agent) {
+						if (!agent->passive_) {
+							agent->computeNeighborCandidates<Traits>();
+						}
+						else {
+							/* Searches nothing, but is a candidate of others, so its displacement still bounds the lists. */
+							agent->candidatePosition_ = agent->position();
+						}
+					});
+				}
+
+				neighborCandidatesDirty_ = false;
+			}
+		}
+		else {
+			kdTree_->buildAgentTree<Traits>();
+			endPhase(phaseTimings_.buildTree, phaseStart);
+
+			if (dualTreeNeighbors_) {
+				kdTree_->computeAllAgentNeighbors<Traits>(false);
+				computedNeighbors = true;
+			}
+		}
+
+		if ((timedPhases_ || urgencyScheduling_) && !computedNeighbors) {
+			/* The time to collision of each agent is taken against its current neighbors. Timed steps search all neighbors before solving, so that the search is timed on its own. */
+			forEachAgent([](Agent *agent) {
+				if (!agent->passive_) {
+					agent->computeNeighbors<Traits>();
+				}
+			});
+
+			computedNeighbors = true;
+		}
+
+		endPhase(phaseTimings_.neighbors, phaseStart);
+
+		if (sharedORCAPlanes_) {
+			/* All neighbor sets must be known before planes are shared. */
+			forEachAgent([computedNeighbors](Agent *agent) {
+				if (!agent->passive_) {
+					if (!computedNeighbors) {
+						agent->computeNeighbors<Traits>();
+					}
+
+					agent->prepareSharedORCAPlanes();
+				}
+			});
+
+			/* Writes the mirrored planes of other agents, so it stays serial. */
+			for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
+				if (!agents_[i]->passive_) {
+					agents_[i]->computeSharedORCAPlanes();
+				}
+			}
+
+			computedNeighbors = true;
+		}
+
+		solverStats_ = SolverStats();
+
+		const size_t numAgents = agents_.size();
+		const bool timeBudget = solveTimeBudget_ > 0.0f && numAgents > 0;
+		const size_t firstAgent = solveCursor_;
+		bool budgetSpent = false;
+		size_t solvedAgents = 0;
+
+		if (urgencyScheduling_) {
+			scheduleByUrgency();
+		}
+
+		/* Agents read the current state of their neighbors and write their own next state, so each agent is solved and moved in a single pass, in any order. Timed steps move the agents in a pass of their own. */
+		const bool moveAgents = !timedPhases_;
+
+		if (executor_ != NULL && !timeBudget && maxSolvedAgents_ == 0) {
+			std::mutex statsMutex;
+
+			executor_->parallelFor(numAgents, [this, computedNeighbors, moveAgents, &statsMutex](size_t begin, size_t end) {
+				SolverStats stats;
+
+				for (size_t i = begin; i < end; ++i) {
+					stepAgent<Traits>(agents_[i], !computedNeighbors, false, stats);
 
-		for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
-			agents_[i]->computeNeighbors();
-			agents_[i]->computeNewVelocity();
+					if (moveAgents) {
+						agents_[i]->update();
+					}
+				}
+
+				std::lock_guard<std::mutex> lock(statsMutex);
+				addSolverStats(stats);
+			});
+		}
+		else {
+			/* The budget covers the solve phase only, the passes above run for all agents. */
+			const std::chrono::steady_clock::time_point solveStart = std::chrono::steady_clock::now();
+
+			for (size_t k = 0; k < numAgents; ++k) {
+				/* Agents are solved by urgency, or round-robin from where the previous step ran out of budget. */
+				const size_t i = urgencyScheduling_ ? solveOrder_[k].second : timeBudget ? (firstAgent + k) % numAgents : k;
+
+				if (!budgetSpent && !agents_[i]->passive_ && solvedAgents > 0 && ((maxSolvedAgents_ > 0 && solvedAgents >= maxSolvedAgents_) || (timeBudget && std::chrono::duration<float>(std::chrono::steady_clock::now() - solveStart).count() > solveTimeBudget_))) {
+					budgetSpent = true;
+					solveCursor_ = i;
+				}
+
+				if (stepAgent<Traits>(agents_[i], !computedNeighbors, budgetSpent, solverStats_)) {
+					++solvedAgents;
+				}
+
+				if (moveAgents) {
+					agents_[i]->update();
+				}
+			}
 		}
 
-		for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
-			agents_[i]->update();
+		endPhase(phaseTimings_.solve, phaseStart);
+
+		if (!moveAgents) {
+			forEachAgent([](Agent *agent) {
+				agent->update();
+			});
+
+			endPhase(phaseTimings_.update, phaseStart);
 		}
 
+		stateIndex_ ^= 1;
+		++stepCount_;
 		globalTime_ += timeStep_;
 	}
 
+	template <class Traits>
+	bool RVOSimulator::stepAgent(Agent *agent, bool computeNeighbors, bool budgetSpent, SolverStats &stats)
+	{
+		if (agent->passive_) {
+			/* Moves on with the velocity it was given, and is avoided by others without taking part. */
+			agent->newVelocity_ = agent->velocity();
+			return false;
+		}
+
+		/* Only bounded steps trade solves for time; unbounded ones are merely reordered. */
+		if (urgencyScheduling_ && (solveTimeBudget_ > 0.0f || maxSolvedAgents_ > 0) && agent->isUpdateDue() && agent->timeToCollision_ > agent->archetype_->timeHorizon && stepCount_ - agent->lastSolveStep_ < maxDeferredSteps_) {
+			/* Safe for its whole time horizon, so the solve would keep its preferred velocity. */
+			++stats.deferredAgents;
+			stats.maxSolveAge = std::max(stats.maxSolveAge, stepCount_ - agent->lastSolveStep_);
+			agent->newVelocity_ = agent->getClampedPrefVelocity();
+
+			if (adaptiveNeighbors_) {
+				agent->updateNeighborBudget();
+			}
+
+			return false;
+		}
+
+		if (budgetSpent || !agent->isUpdateDue()) {
+			/* Moves on with its last solved velocity, while staying in the tree as a neighbor of others. */
+			++stats.deferredAgents;
+			stats.maxSolveAge = std::max(stats.maxSolveAge, stepCount_ - agent->lastSolveStep_);
+			return false;
+		}
+
+		agent->lastSolveStep_ = stepCount_;
+
+		if (computeNeighbors) {
+			agent->computeNeighbors<Traits>();
+		}
+
+		agent->computeNewVelocity<Traits>();
+
+		switch (agent->solvePath_) {
+		case Agent::SOLVE_ISOLATED:
+			++stats.isolatedAgents;
+			break;
+		case Agent::SOLVE_UNCONSTRAINED:
+			++stats.unconstrainedAgents;
+			break;
+		case Agent::SOLVE_LINEAR_PROGRAM_3:
+			++stats.linearProgram3Agents;
+			break;
+		case Agent::SOLVE_LINEAR_PROGRAM_4:
+			++stats.linearProgram4Agents;
+			break;
+		}
+
+		if (agent->budgetExceeded_) {
+			++stats.budgetExceededAgents;
+		}
+
+		if (adaptiveNeighbors_) {
+			agent->updateNeighborBudget();
+		}
+
+		return true;
+	}
+
+	void RVOSimulator::endPhase(float &phaseTime, std::chrono::steady_clock::time_point &phaseStart) const
+	{
+		if (timedPhases_) {
+			const std::chrono::steady_clock::time_point phaseEnd = std::chrono::steady_clock::now();
+
+			phaseTime += std::chrono::duration<float>(phaseEnd - phaseStart).count();
+			phaseStart = phaseEnd;
+		}
+	}
+
+	void RVOSimulator::addSolverStats(const SolverStats &stats)
+	{
+		solverStats_.isolatedAgents += stats.isolatedAgents;
+		solverStats_.unconstrainedAgents += stats.unconstrainedAgents;
+		solverStats_.linearProgram3Agents += stats.linearProgram3Agents;
+		solverStats_.linearProgram4Agents += stats.linearProgram4Agents;
+		solverStats_.budgetExceededAgents += stats.budgetExceededAgents;
+		solverStats_.deferredAgents += stats.deferredAgents;
+		solverStats_.maxSolveAge = std::max(solverStats_.maxSolveAge, stats.maxSolveAge);
+	}
+
+	template <class Function>
+	void RVOSimulator::forEachAgent(const Function &function)
+	{
+		if (executor_ != NULL) {
+			executor_->parallelFor(agents_.size(), [this, &function](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					function(agents_[i]);
+				}
+			});
+		}
+		else {
+			for (size_t i = 0; i < agents_.size(); ++i) {
+				function(agents_[i]);
+			}
+		}
+	}
+
+	void RVOSimulator::scheduleByUrgency()
+	{
+		solveOrder_.resize(agents_.size());
+
+		forEachAgent([](Agent *agent) {
+			agent->timeToCollision_ = agent->computeTimeToCollision();
+		});
+
+		for (size_t i = 0; i < agents_.size(); ++i) {
+			const Agent *agent = agents_[i];
+
+			/* Agents deferred for too long go first, so that they are solved even under a tight budget. */
+			solveOrder_[i] = std::make_pair(stepCount_ - agent->lastSolveStep_ >= maxDeferredSteps_ ? -1.0f : agent->timeToCollision_, i);
+		}
+
+		std::sort(solveOrder_.begin(), solveOrder_.end());
+	}
+
+	bool RVOSimulator::shouldComputeNeighborCandidates() const
+	{
+		const float maxDisplacementSq = sqr(0.5f * neighborSkin_);
+
+		for (size_t i = 0; i < agents_.size(); ++i) {
+			if (absSq(agents_[i]->position() - agents_[i]->candidatePosition_) > maxDisplacementSq) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
 	size_t RVOSimulator::getAgentMaxNeighbors(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->maxNeighbors_;
+		return findAgent(agentNo)->archetype_->maxNeighbors;
+	}
+
+	size_t RVOSimulator::getAgentMinNeighbors(size_t agentNo) const
+	{
+		return findAgent(agentNo)->archetype_->minNeighbors;
+	}
+
+	size_t RVOSimulator::getAgentEffectiveMaxNeighbors(size_t agentNo) const
+	{
+		return findAgent(agentNo)->effectiveMaxNeighbors_;
 	}
 
 	float RVOSimulator::getAgentMaxSpeed(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->maxSpeed_;
+		return findAgent(agentNo)->archetype_->maxSpeed;
 	}
 
 	float RVOSimulator::getAgentNeighborDist(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->neighborDist_;
+		return findAgent(agentNo)->archetype_->neighborDist;
+	}
+
+	size_t RVOSimulator::getAgentArchetype(size_t agentNo) const
+	{
+		return findAgent(agentNo)->archetypeNo_;
 	}
 
 	const Vector3 &RVOSimulator::getAgentPosition(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->position_;
+		return findAgent(agentNo)->position();
 	}
 
 	const Vector3 &RVOSimulator::getAgentPrefVelocity(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->prefVelocity_;
+		return findAgent(agentNo)->prefVelocity_;
 	}
 
 	float RVOSimulator::getAgentRadius(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->radius_;
+		return findAgent(agentNo)->archetype_->radius;
 	}
 
 	float RVOSimulator::getAgentTimeHorizon(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->timeHorizon_;
+		return findAgent(agentNo)->archetype_->timeHorizon;
+	}
+
+	size_t RVOSimulator::getAgentUpdateInterval(size_t agentNo) const
+	{
+		return findAgent(agentNo)->updateInterval_;
+	}
+
+	size_t RVOSimulator::getAgentStepMultiple(size_t agentNo) const
+	{
+		return findAgent(agentNo)->archetype_->stepMultiple;
 	}
 
 	const Vector3 &RVOSimulator::getAgentVelocity(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->velocity_;
+		return findAgent(agentNo)->velocity();
+	}
+
+	const Vector3 &RVOSimulator::getAgentPreviousVelocity(size_t agentNo) const
+	{
+		/* The step read its input velocity from the other state buffer. */
+		return findAgent(agentNo)->velocities_[stateIndex_ ^ 1];
+	}
+
+	bool RVOSimulator::isAgentPassive(size_t agentNo) const
+	{
+		return findAgent(agentNo)->passive_;
+	}
+
+	bool RVOSimulator::isAgentPlanar(size_t agentNo) const
+	{
+		return findAgent(agentNo)->archetype_->planar;
 	}
 
 	bool RVOSimulator::isAgentValid(size_t agentNo) const
 	{
-		return agentMap_.FindChecked(agentNo)->valid_;
+		return findAgent(agentNo)->valid_;
+	}
+
+	const AgentArchetype &RVOSimulator::getArchetype(size_t archetypeNo) const
+	{
+		return archetypes_[archetypeNo].archetype;
+	}
+
+	size_t RVOSimulator::getNumArchetypes() const
+	{
+		return archetypes_.size();
 	}
 
 	float RVOSimulator::getGlobalTime() const
@@ -198,6 +696,91 @@ namespace RVO {
 		return agents_.size();
 	}
 
+	size_t RVOSimulator::getMaxORCAPlanes() const
+	{
+		return maxORCAPlanes_;
+	}
+
+	size_t RVOSimulator::getMaxSolverIterations() const
+	{
+		return maxSolverIterations_;
+	}
+
+	const PhaseTimings &RVOSimulator::getPhaseTimings() const
+	{
+		return phaseTimings_;
+	}
+
+	const SolverStats &RVOSimulator::getSolverStats() const
+	{
+		return solverStats_;
+	}
+
+	bool RVOSimulator::getDualTreeNeighborSearch() const
+	{
+		return dualTreeNeighbors_;
+	}
+
+	bool RVOSimulator::getSharedORCAPlanes() const
+	{
+		return sharedORCAPlanes_;
+	}
+
+	bool RVOSimulator::getVelocityPruning() const
+	{
+		return velocityPruning_;
+	}
+
+	float RVOSimulator::getVelocityPruningMargin() const
+	{
+		return velocityPruningMargin_;
+	}
+
+	bool RVOSimulator::getAdaptiveNeighbors() const
+	{
+		return adaptiveNeighbors_;
+	}
+
+	bool RVOSimulator::getWarmStartedSolve() const
+	{
+		return warmStartedSolve_;
+	}
+
+	float RVOSimulator::getNeighborSkin() const
+	{
+		return neighborSkin_;
+	}
+
+	size_t RVOSimulator::getMaxSolvedAgents() const
+	{
+		return maxSolvedAgents_;
+	}
+
+	bool RVOSimulator::getUrgencyScheduling() const
+	{
+		return urgencyScheduling_;
+	}
+
+	size_t RVOSimulator::getMaxDeferredSteps() const
+	{
+		return maxDeferredSteps_;
+	}
+
+	Executor *RVOSimulator::getExecutor() const
+	{
+		return executor_;
+	}
+
+	bool RVOSimulator::getTimedPhases() const
+	{
+		return timedPhases_;
+	}
+
+	float RVOSimulator::getSolveTimeBudget() const
+	{
+		return solveTimeBudget_;
+	}
+
 	float RVOSimulator::getTimeStep() const
 	{
 		return timeStep_;
@@ -209,115 +792,253 @@ namespace RVO {
 			defaultAgent_ = new Agent(this);
 		}
 
-		defaultAgent_->maxNeighbors_ = maxNeighbors;
-		defaultAgent_->maxSpeed_ = maxSpeed;
-		defaultAgent_->neighborDist_ = neighborDist;
-		defaultAgent_->radius_ = radius;
-		defaultAgent_->timeHorizon_ = timeHorizon;
-		defaultAgent_->avoidanceGroup_ = avoidanceGroup;
-		defaultAgent_->groupsToAvoid_ = groupsToAvoid;
-		defaultAgent_->groupsToIgnore_ = groupsToIgnore;
-		defaultAgent_->velocity_ = velocity;
+		assignArchetype(defaultAgent_, acquireArchetype(AgentArchetype(neighborDist, maxNeighbors, timeHorizon, radius, maxSpeed, avoidanceGroup, groupsToAvoid, groupsToIgnore)));
+		defaultAgent_->velocity() = velocity;
+	}
+
+	void RVOSimulator::setAgentArchetype(size_t agentNo, size_t archetypeNo)
+	{
+		Agent *agent = findAgent(agentNo);
+
+		assignArchetype(agent, archetypeNo);
+		agent->resetNeighborBudget();
+		neighborCandidatesDirty_ = true;
+	}
+
+	void RVOSimulator::setArchetype(size_t archetypeNo, const AgentArchetype &archetype)
+	{
+		if (!archetypes_[archetypeNo].isPrivate) {
+			/* Indexed under its new parameters. */
+			unindexArchetype(archetypeNo);
+			archetypeIndex_.insert(std::make_pair(hashArchetype(archetype), archetypeNo));
+		}
+
+		archetypes_[archetypeNo].archetype = archetype;
+
+		if (archetypes_[archetypeNo].refCount > 0) {
+			for (size_t i = 0; i < agents_.size(); ++i) {
+				if (agents_[i]->archetypeNo_ == archetypeNo) {
+					agents_[i]->resetNeighborBudget();
+				}
+			}
+
+			neighborCandidatesDirty_ = true;
+		}
 	}
 
 	void RVOSimulator::setAgentMaxNeighbors(size_t agentNo, size_t maxNeighbors)
 	{
-		agentMap_.FindChecked(agentNo)->maxNeighbors_ = maxNeighbors;
+		Agent *agent = findAgent(agentNo);
+
+		overrideArchetype(agent).maxNeighbors = maxNeighbors;
+		agent->resetNeighborBudget();
+		neighborCandidatesDirty_ = true;
+	}
+
+	void RVOSimulator::setAgentMinNeighbors(size_t agentNo, size_t minNeighbors)
+	{
+		overrideArchetype(findAgent(agentNo)).minNeighbors = minNeighbors;
 	}
 
 	void RVOSimulator::setAgentMaxSpeed(size_t agentNo, float maxSpeed)
 	{
-		agentMap_.FindChecked(agentNo)->maxSpeed_ = maxSpeed;
+		overrideArchetype(findAgent(agentNo)).maxSpeed = maxSpeed;
 	}
 
 	void RVOSimulator::setAgentNeighborDist(size_t agentNo, float neighborDist)
 	{
-		agentMap_.FindChecked(agentNo)->neighborDist_ = neighborDist;
+		overrideArchetype(findAgent(agentNo)).neighborDist = neighborDist;
+		neighborCandidatesDirty_ = true;
+	}
+
+	void RVOSimulator::setAgentPassive(size_t agentNo, bool passive)
+	{
+		Agent *agent = findAgent(agentNo);
+
+		if (agent->passive_ != passive) {
+			/* The neighbors and planes of a passive agent are no longer updated. */
+			agent->passive_ = passive;
+			agent->agentNeighbors_.clear();
+			agent->orcaPlanes_.clear();
+			agent->neighborCandidates_.clear();
+			agent->bindingNeighbors_.clear();
+			neighborCandidatesDirty_ = true;
+		}
+	}
+
+	void RVOSimulator::setAgentPlanar(size_t agentNo, bool planar)
+	{
+		overrideArchetype(findAgent(agentNo)).planar = planar;
+	}
+
+	void RVOSimulator::setAgentStepMultiple(size_t agentNo, size_t stepMultiple)
+	{
+		overrideArchetype(findAgent(agentNo)).stepMultiple = std::max<size_t>(stepMultiple, 1);
 	}
 
 	void RVOSimulator::setAgentPosition(size_t agentNo, const Vector3 &position)
 	{
-		agentMap_.FindChecked(agentNo)->position_ = position;
+		findAgent(agentNo)->position() = position;
 	}
 
 	void RVOSimulator::setAgentPrefVelocity(size_t agentNo, const Vector3 &prefVelocity)
 	{
-		agentMap_.FindChecked(agentNo)->prefVelocity_ = prefVelocity;
+		findAgent(agentNo)->prefVelocity_ = prefVelocity;
 	}
 
 	void RVOSimulator::setAgentRadius(size_t agentNo, float radius)
 	{
-		agentMap_.FindChecked(agentNo)->radius_ = radius;
+		overrideArchetype(findAgent(agentNo)).radius = radius;
 	}
 
 	void RVOSimulator::setAgentTimeHorizon(size_t agentNo, float timeHorizon)
 	{
-		agentMap_.FindChecked(agentNo)->timeHorizon_ = timeHorizon;
+		overrideArchetype(findAgent(agentNo)).timeHorizon = timeHorizon;
+	}
+
+	void RVOSimulator::setAgentUpdateInterval(size_t agentNo, size_t updateInterval)
+	{
+		findAgent(agentNo)->updateInterval_ = std::max<size_t>(updateInterval, 1);
 	}
 
 	void RVOSimulator::setAgentVelocity(size_t agentNo, const Vector3 &velocity)
 	{
-		agentMap_.FindChecked(agentNo)->velocity_ = velocity;
+		findAgent(agentNo)->velocity() = velocity;
 	}
 
     // Avoidance Group
 
 	void RVOSimulator::setAgentAvoidanceGroup(size_t agentNo, int mask)
 	{
-		agentMap_.FindChecked(agentNo)->avoidanceGroup_ = mask;
+		overrideArchetype(findAgent(agentNo)).avoidanceGroup = mask;
 	}
 
 	void RVOSimulator::setAgentGroupsToAvoid(size_t agentNo, int mask)
 	{
-		agentMap_.FindChecked(agentNo)->groupsToAvoid_ = mask;
+		overrideArchetype(findAgent(agentNo)).groupsToAvoid = mask;
 	}
 
 	void RVOSimulator::setAgentGroupsToIgnore(size_t agentNo, int mask)
 	{
-		agentMap_.FindChecked(agentNo)->groupsToIgnore_ = mask;
+		overrideArchetype(findAgent(agentNo)).groupsToIgnore = mask;
 	}
 
     // Agent Exclusions
 
 	void RVOSimulator::addAgentNeighborToIgnore(size_t agentNo, size_t ignoredNo)
 	{
-		agentMap_.FindChecked(agentNo)->agentsToIgnore_.Emplace(ignoredNo);
+		findAgent(agentNo)->agentsToIgnore_.add(ignoredNo);
 	}
 
 	void RVOSimulator::removeAgentNeighborToIgnore(size_t agentNo, size_t ignoredNo)
 	{
-		agentMap_.FindChecked(agentNo)->agentsToIgnore_.Remove(ignoredNo);
+		findAgent(agentNo)->agentsToIgnore_.remove(ignoredNo);
 	}
 
-	void RVOSimulator::setAgentIgnoredNeighbors(size_t agentNo, const TArray<int>& ignoredArr)
+	void RVOSimulator::setAgentIgnoredNeighbors(size_t agentNo, const size_t *ignoredNos, size_t count)
 	{
-		agentMap_.FindChecked(agentNo)->agentsToIgnore_.Append(ignoredArr);
-	}
+		IgnoreList &agentsToIgnore = findAgent(agentNo)->agentsToIgnore_;
 
-	void RVOSimulator::setAgentIgnoredNeighbors(size_t agentNo, const TSet<int>& ignoredSet)
-	{
-		agentMap_.FindChecked(agentNo)->agentsToIgnore_ = ignoredSet;
+		agentsToIgnore.clear();
+		agentsToIgnore.add(ignoredNos, count);
 	}
 
 	void RVOSimulator::clearAgentIgnoredNeighbors(size_t agentNo, bool bAllowShrinking)
 	{
-        Agent* Agent( agentMap_.FindChecked(agentNo) );
-
-        Agent->agentsToIgnore_.Reset();
+        Agent* Agent( findAgent(agentNo) );
 
-        if (bAllowShrinking)
-        {
-            Agent->agentsToIgnore_.Shrink();
-        }
+        Agent->agentsToIgnore_.clear(bAllowShrinking);
 	}
 
 	//void RVOSimulator::setAgentDebug(size_t agentNo, bool debug)
 	//{
-	//    agentMap_.FindChecked(agentNo)->debug_ = debug;
+	//    findAgent(agentNo)->debug_ = debug;
 	//}
 
+	void RVOSimulator::setSolverBudget(size_t maxORCAPlanes, size_t maxSolverIterations)
+	{
+		maxORCAPlanes_ = maxORCAPlanes;
+		maxSolverIterations_ = maxSolverIterations;
+	}
+
+	void RVOSimulator::setDualTreeNeighborSearch(bool dualTree)
+	{
+		dualTreeNeighbors_ = dualTree;
+	}
+
+	void RVOSimulator::setSharedORCAPlanes(bool sharedPlanes)
+	{
+		sharedORCAPlanes_ = sharedPlanes;
+	}
+
+	void RVOSimulator::setVelocityPruning(bool velocityPruning, float margin)
+	{
+		velocityPruning_ = velocityPruning;
+		velocityPruningMargin_ = margin;
+	}
+
+	void RVOSimulator::setAdaptiveNeighbors(bool adaptiveNeighbors, float smoothing, float headroom)
+	{
+		adaptiveNeighbors_ = adaptiveNeighbors;
+		adaptiveNeighborSmoothing_ = smoothing;
+		adaptiveNeighborHeadroom_ = headroom;
+
+		for (size_t i = 0; i < agents_.size(); ++i) {
+			agents_[i]->resetNeighborBudget();
+		}
+	}
+
+	void RVOSimulator::setWarmStartedSolve(bool warmStartedSolve)
+	{
+		warmStartedSolve_ = warmStartedSolve;
+
+		for (size_t i = 0; i < agents_.size(); ++i) {
+			agents_[i]->bindingNeighbors_.clear();
+		}
+	}
+
+	void RVOSimulator::setNeighborSkin(float neighborSkin)
+	{
+		neighborSkin_ = neighborSkin;
+		neighborCandidatesDirty_ = true;
+	}
+
+	void RVOSimulator::setMaxSolvedAgents(size_t maxSolvedAgents)
+	{
+		maxSolvedAgents_ = maxSolvedAgents;
+	}
+
+	void RVOSimulator::setUrgencyScheduling(bool urgencyScheduling, size_t maxDeferredSteps)
+	{
+		urgencyScheduling_ = urgencyScheduling;
+		maxDeferredSteps_ = std::max<size_t>(maxDeferredSteps, 1);
+	}
+
+	void RVOSimulator::setExecutor(Executor *executor)
+	{
+		executor_ = executor;
+	}
+
+	void RVOSimulator::setTimedPhases(bool timedPhases)
+	{
+		timedPhases_ = timedPhases;
+		phaseTimings_ = PhaseTimings();
+	}
+
+	void RVOSimulator::setSolveTimeBudget(float solveTimeBudget)
+	{
+		solveTimeBudget_ = std::max(solveTimeBudget, 0.0f);
+	}
+
 	void RVOSimulator::setTimeStep(float timeStep)
 	{
 		timeStep_ = timeStep;
 	}
+
+#define RVO_INSTANTIATE_SIMULATOR(Traits) \
+	template void RVOSimulator::doStep<Traits>();
+
+	RVO_SIMULATOR_TRAITS(RVO_INSTANTIATE_SIMULATOR)
+
+#undef RVO_INSTANTIATE_SIMULATOR
 }
@@ -2,14 +2,20 @@
 #ifndef RVO_RVO_SIMULATOR_H_
 #define RVO_RVO_SIMULATOR_H_
 
+#include <cassert>
+#include <chrono>
 #include <cstddef>
+#include <deque>
 #include <limits>
+#include <unordered_map>
 #include <vector>
 
+#include "Platform.h"
 #include "Vector3.h"
 
 namespace RVO {
 	class Agent;
+	class Executor;
 	class KdTree;
 
 	/**
@@ -19,6 +25,50 @@ namespace RVO {
 	 */
 	const size_t RVO_ERROR = std::numeric_limits<size_t>::max();
 
+	/**
+	 * \brief   Defines the default compile-time configuration of the simulation.
+	 *
+	 * Custom configurations define the same members and are listed in RVO_SIMULATOR_TRAITS.
+	 */
+	struct DefaultSimulatorTraits {
+		/**
+		 * \brief   The maximum number of agents in a leaf of the agent <i>k</i>d-tree.
+		 */
+		static const size_t MaxLeafSize = 10;
+
+		/**
+		 * \brief   The upper bound on the neighbor count of every agent, or zero if bounded only by the agent parameters. When nonzero, the fourth linear program keeps its projected planes on the stack. The ORCA planes and neighbor lists of the agents are heap vectors either way.
+		 */
+		static const size_t MaxNeighbors = 0;
+
+		/**
+		 * \brief   True if avoidance group masks are taken into account.
+		 */
+		static const bool GroupMasks = true;
+
+		/**
+		 * \brief   True if the agent ignore lists are taken into account.
+		 */
+		static const bool IgnoreLists = true;
+	};
+
+	/**
+	 * \brief   Defines a compile-time configuration for crowds of a bounded neighbor count that use neither group masks nor ignore lists.
+	 */
+	struct CompactSimulatorTraits {
+		static const size_t MaxLeafSize = 10;
+		static const size_t MaxNeighbors = 16;
+		static const bool GroupMasks = false;
+		static const bool IgnoreLists = false;
+	};
+
+	/**
+	 * \brief   Applies a macro to every compile-time configuration the simulation is instantiated for. A custom configuration must be added here.
+	 */
+#define RVO_SIMULATOR_TRAITS(X) \
+	X(DefaultSimulatorTraits) \
+	X(CompactSimulatorTraits)
+
 	/**
 	 * \brief   Defines a plane.
 	 */
@@ -35,6 +85,174 @@ namespace RVO {
 		Vector3 normal;
 	};
 
+	/**
+	 * \brief   Defines a block of agent parameters shared by all agents of a unit type.
+	 *
+	 * Agents reference an archetype instead of storing their own parameters. Changing a parameter of a single agent gives that agent a private copy of its archetype.
+	 */
+	class AgentArchetype {
+	public:
+		/**
+		 * \brief   Constructs an archetype instance with zero parameters, avoiding all groups.
+		 */
+		AgentArchetype() : maxNeighbors(0), minNeighbors(0), maxSpeed(0.0f), neighborDist(0.0f), radius(0.0f), timeHorizon(0.0f), avoidanceGroup(1), groupsToAvoid(-1), groupsToIgnore(0), planar(false), stepMultiple(1) { }
+
+		/**
+		 * \brief   Constructs an archetype instance.
+		 * \param   agentNeighborDist    The maximum distance (center point to center point) to other agents an agent takes into account in the navigation. Must be non-negative.
+		 * \param   agentMaxNeighbors    The maximum number of other agents an agent takes into account in the navigation.
+		 * \param   agentTimeHorizon     The minimum amount of time for which an agent's velocities that are computed by the simulation are safe with respect to other agents. Must be positive.
+		 * \param   agentRadius          The radius of an agent. Must be non-negative.
+		 * \param   agentMaxSpeed        The maximum speed of an agent. Must be non-negative.
+		 * \param   agentAvoidanceGroup  The 32-bit mask of the avoidance group of an agent.
+		 * \param   agentGroupsToAvoid   The 32-bit mask of groups to be included in the avoidance calculation.
+		 * \param   agentGroupsToIgnore  The 32-bit mask of groups to be ignored in the avoidance calculation.
+		 */
+		AgentArchetype(float agentNeighborDist, size_t agentMaxNeighbors, float agentTimeHorizon, float agentRadius, float agentMaxSpeed, int agentAvoidanceGroup = 1, int agentGroupsToAvoid = -1, int agentGroupsToIgnore = 0) : maxNeighbors(agentMaxNeighbors), minNeighbors(0), maxSpeed(agentMaxSpeed), neighborDist(agentNeighborDist), radius(agentRadius), timeHorizon(agentTimeHorizon), avoidanceGroup(agentAvoidanceGroup), groupsToAvoid(agentGroupsToAvoid), groupsToIgnore(agentGroupsToIgnore), planar(false), stepMultiple(1) { }
+
+		/**
+		 * \brief   Tests this archetype for equality with the specified archetype.
+		 * \param   other  The archetype with which to test for equality.
+		 * \return  True if all parameters are equal.
+		 */
+		bool operator==(const AgentArchetype &other) const
+		{
+			return maxNeighbors == other.maxNeighbors && minNeighbors == other.minNeighbors && maxSpeed == other.maxSpeed && neighborDist == other.neighborDist && radius == other.radius && timeHorizon == other.timeHorizon && avoidanceGroup == other.avoidanceGroup && groupsToAvoid == other.groupsToAvoid && groupsToIgnore == other.groupsToIgnore && planar == other.planar && stepMultiple == other.stepMultiple;
+		}
+
+		/**
+		 * \brief   The maximum number of other agents taken into account in the navigation.
+		 */
+		size_t maxNeighbors;
+
+		/**
+		 * \brief   The lower bound of the neighbor count when adaptive neighbor counts are enabled.
+		 */
+		size_t minNeighbors;
+
+		/**
+		 * \brief   The maximum speed.
+		 */
+		float maxSpeed;
+
+		/**
+		 * \brief   The maximum distance (center point to center point) to other agents taken into account in the navigation.
+		 */
+		float neighborDist;
+
+		/**
+		 * \brief   The radius.
+		 */
+		float radius;
+
+		/**
+		 * \brief   The minimum amount of time for which computed velocities are safe with respect to other agents.
+		 */
+		float timeHorizon;
+
+		/**
+		 * \brief   The 32-bit mask of the avoidance group.
+		 */
+		int avoidanceGroup;
+
+		/**
+		 * \brief   The 32-bit mask of groups to be included in the avoidance calculation.
+		 */
+		int groupsToAvoid;
+
+		/**
+		 * \brief   The 32-bit mask of groups to be ignored in the avoidance calculation.
+		 */
+		int groupsToIgnore;
+
+		/**
+		 * \brief   True if agents keep their height and solve for a horizontal velocity only. Other agents are avoided where they overlap the layer of the agent.
+		 */
+		bool planar;
+
+		/**
+		 * \brief   The number of simulation steps between two solves. Slow agents can be solved less often than fast ones, while still moving and being avoided every step.
+		 */
+		size_t stepMultiple;
+	};
+
+	/**
+	 * \brief   Defines the counters of the velocity solve paths taken during the last simulation step.
+	 */
+	class SolverStats {
+	public:
+		/**
+		 * \brief   Constructs a zeroed set of counters.
+		 */
+		SolverStats() : isolatedAgents(0), unconstrainedAgents(0), linearProgram3Agents(0), linearProgram4Agents(0), budgetExceededAgents(0), deferredAgents(0), maxSolveAge(0) { }
+
+		/**
+		 * \brief   The number of agents without neighbors, whose preferred velocity was clamped to their maximum speed.
+		 */
+		size_t isolatedAgents;
+
+		/**
+		 * \brief   The number of agents whose preferred velocity violated none of their ORCA planes.
+		 */
+		size_t unconstrainedAgents;
+
+		/**
+		 * \brief   The number of agents solved by the 3-d linear program.
+		 */
+		size_t linearProgram3Agents;
+
+		/**
+		 * \brief   The number of agents with infeasible constraints, solved by the 4-d linear program.
+		 */
+		size_t linearProgram4Agents;
+
+		/**
+		 * \brief   The number of agents that exhausted the solver iteration budget.
+		 */
+		size_t budgetExceededAgents;
+
+		/**
+		 * \brief   The number of agents not due for a solve, which kept their last solved velocity.
+		 */
+		size_t deferredAgents;
+
+		/**
+		 * \brief   The largest number of steps since a deferred agent was last solved.
+		 */
+		size_t maxSolveAge;
+	};
+
+	/**
+	 * \brief   Defines the wall-clock time spent in each phase of the last simulation step, in seconds. Only measured while timed phases are enabled.
+	 */
+	class PhaseTimings {
+	public:
+		/**
+		 * \brief   Constructs a zeroed set of timings.
+		 */
+		PhaseTimings() : buildTree(0.0f), neighbors(0.0f), solve(0.0f), update(0.0f) { }
+
+		/**
+		 * \brief   The time spent building the agent <i>k</i>d-tree.
+		 */
+		float buildTree;
+
+		/**
+		 * \brief   The time spent searching the neighbors of the agents, or their neighbor candidates.
+		 */
+		float neighbors;
+
+		/**
+		 * \brief   The time spent computing ORCA planes and solving for the new velocities, including the scheduling of the solves.
+		 */
+		float solve;
+
+		/**
+		 * \brief   The time spent moving the agents to their next state.
+		 */
+		float update;
+	};
+
 	/**
 	 * \brief  Defines the simulation.
 	 *
@@ -62,7 +280,7 @@ namespace RVO {
 		/**
 		 * \brief   Destroys this simulator instance.
 		 */
-		~RVOSimulator();
+		virtual ~RVOSimulator();
 
 		/**
 		 * \brief   Adds a new agent with default properties to the simulation.
@@ -84,10 +302,46 @@ namespace RVO {
 		 */
 		size_t addAgent(const Vector3 &position, float neighborDist, size_t maxNeighbors, float timeHorizon, float radius, float maxSpeed, int avoidanceGroup = 1, int groupsToAvoid = -1, int groupsToIgnore = 0, const Vector3 &velocity = Vector3());
 
+		/**
+		 * \brief   Adds a new agent referencing an archetype to the simulation.
+		 * \param   position     The three-dimensional starting position of this agent.
+		 * \param   archetypeNo  The number of the archetype whose parameters this agent uses.
+		 * \param   velocity     The initial three-dimensional linear velocity of this agent (optional).
+		 * \return  The number of the agent.
+		 */
+		size_t addAgent(const Vector3 &position, size_t archetypeNo, const Vector3 &velocity = Vector3());
+
+		/**
+		 * \brief   Adds a new archetype to the simulation. It is kept for the lifetime of the simulation, even while no agent references it.
+		 * \param   archetype  The parameters of the archetype.
+		 * \return  The number of the archetype.
+		 */
+		size_t addArchetype(const AgentArchetype &archetype);
+
+		/**
+		 * \brief   Returns a shared archetype with the specified parameters, adding one if none exists. An archetype added this way is recycled once the last agent referencing it releases it.
+		 * \param   archetype  The parameters of the archetype.
+		 * \return  The number of the archetype.
+		 */
+		size_t acquireArchetype(const AgentArchetype &archetype);
+
+		/**
+		 * \brief   Finds a shared archetype with the specified parameters.
+		 * \param   archetype  The parameters of the archetype.
+		 * \return  The number of the archetype, or RVO::RVO_ERROR when no shared archetype has these parameters.
+		 */
+		size_t findArchetype(const AgentArchetype &archetype) const;
+
 		/**
 		 * \brief   Lets the simulator perform a simulation step and updates the three-dimensional position and three-dimensional velocity of each agent.
 		 */
-		void doStep();
+		virtual void doStep();
+
+		/**
+		 * \brief   Moves the origin of the simulation, translating the three-dimensional position of each agent by the negated offset.
+		 * \param   offset  The offset from the current origin to the new origin.
+		 */
+		void shiftOrigin(const Vector3 &offset);
 
 		/**
 		 * \brief   Checks whether agent with the specified id exists.
@@ -96,6 +350,27 @@ namespace RVO {
 		 */
 		FORCEINLINE bool hasAgent(size_t agentNo) const;
 
+		/**
+		 * \brief   Returns the archetype of a specified agent.
+		 * \param   agentNo  The number of the agent whose archetype is to be retrieved.
+		 * \return  The number of the archetype whose parameters the agent uses.
+		 */
+		FORCEINLINE size_t getAgentArchetype(size_t agentNo) const;
+
+		/**
+		 * \brief   Returns whether a specified agent is planar.
+		 * \param   agentNo  The number of the agent whose planar mode is to be retrieved.
+		 * \return  True if the agent keeps its height and solves for a horizontal velocity only.
+		 */
+		FORCEINLINE bool isAgentPlanar(size_t agentNo) const;
+
+		/**
+		 * \brief   Returns whether a specified agent is passive.
+		 * \param   agentNo  The number of the agent whose passive mode is to be retrieved.
+		 * \return  True if the agent is avoided by other agents but never solved.
+		 */
+		FORCEINLINE bool isAgentPassive(size_t agentNo) const;
+
 		/**
 		 * \brief   Returns the count of agent neighbors taken into account to compute the current velocity for the specified agent.
 		 * \param   agentNo  The number of the agent whose count of agent neighbors is to be retrieved.
@@ -118,6 +393,20 @@ namespace RVO {
 		 */
 		FORCEINLINE size_t getAgentMaxNeighbors(size_t agentNo) const;
 
+		/**
+		 * \brief   Returns the lower bound of the adaptive neighbor count of a specified agent.
+		 * \param   agentNo  The number of the agent whose minimum neighbor count is to be retrieved.
+		 * \return  The present minimum neighbor count of the agent.
+		 */
+		FORCEINLINE size_t getAgentMinNeighbors(size_t agentNo) const;
+
+		/**
+		 * \brief   Returns the neighbor count a specified agent currently takes into account, between its minimum and maximum neighbor counts when adaptive neighbor counts are enabled.
+		 * \param   agentNo  The number of the agent whose effective neighbor count is to be retrieved.
+		 * \return  The present effective maximum neighbor count of the agent.
+		 */
+		FORCEINLINE size_t getAgentEffectiveMaxNeighbors(size_t agentNo) const;
+
 		/**
 		 * \brief   Returns the maximum speed of a specified agent.
 		 * \param   agentNo  The number of the agent whose maximum speed is to be retrieved.
@@ -176,6 +465,20 @@ namespace RVO {
 		 */
 		FORCEINLINE float getAgentTimeHorizon(size_t agentNo) const;
 
+		/**
+		 * \brief   Returns the update interval of a specified agent.
+		 * \param   agentNo  The number of the agent whose update interval is to be retrieved.
+		 * \return  The number of simulation steps between two solves of the agent, applied on top of its step multiple.
+		 */
+		FORCEINLINE size_t getAgentUpdateInterval(size_t agentNo) const;
+
+		/**
+		 * \brief   Returns the step multiple of a specified agent.
+		 * \param   agentNo  The number of the agent whose step multiple is to be retrieved.
+		 * \return  The number of simulation steps between two solves of the agent, before its update interval applies.
+		 */
+		FORCEINLINE size_t getAgentStepMultiple(size_t agentNo) const;
+
 		/**
 		 * \brief   Returns the three-dimensional linear velocity of a specified agent.
 		 * \param   agentNo  The number of the agent whose three-dimensional linear velocity is to be retrieved.
@@ -183,6 +486,13 @@ namespace RVO {
 		 */
 		FORCEINLINE const Vector3 &getAgentVelocity(size_t agentNo) const;
 
+		/**
+		 * \brief   Returns the three-dimensional linear velocity of a specified agent before the last simulation step: the result of the step before it, or the velocity set before the step.
+		 * \param   agentNo  The number of the agent whose previous three-dimensional linear velocity is to be retrieved.
+		 * \return  The three-dimensional linear velocity of the agent before the last simulation step.
+		 */
+		FORCEINLINE const Vector3 &getAgentPreviousVelocity(size_t agentNo) const;
+
 		/**
 		 * \brief   Returns whether agent velocity calculation is valid.
 		 * \param   agentNo  The agent id.
@@ -190,6 +500,19 @@ namespace RVO {
 		 */
         FORCEINLINE bool isAgentValid(size_t agentNo) const;
 
+		/**
+		 * \brief   Returns the parameters of a specified archetype.
+		 * \param   archetypeNo  The number of the archetype whose parameters are to be retrieved.
+		 * \return  The present parameters of the archetype.
+		 */
+		const AgentArchetype &getArchetype(size_t archetypeNo) const;
+
+		/**
+		 * \brief   Returns the count of archetypes in the simulation, including private copies made for agents with overridden parameters and recycled archetypes awaiting reuse.
+		 * \return  The count of archetypes in the simulation.
+		 */
+		size_t getNumArchetypes() const;
+
 		/**
 		 * \brief   Returns the global time of the simulation.
 		 * \return  The present global time of the simulation (zero initially).
@@ -202,6 +525,108 @@ namespace RVO {
 		 */
 		size_t getNumAgents() const;
 
+		/**
+		 * \brief   Returns the maximum number of ORCA planes an agent takes into account.
+		 * \return  The present plane budget, or zero if unbounded.
+		 */
+		size_t getMaxORCAPlanes() const;
+
+		/**
+		 * \brief   Returns the maximum number of 3-d linear programs an agent may solve when its constraints are infeasible.
+		 * \return  The present iteration budget, or zero if unbounded.
+		 */
+		size_t getMaxSolverIterations() const;
+
+		/**
+		 * \brief   Returns the counters of the velocity solve paths taken during the last simulation step.
+		 * \return  The solver counters of the last simulation step.
+		 */
+		const SolverStats &getSolverStats() const;
+
+		/**
+		 * \brief   Returns the wall-clock time spent in each phase of the last simulation step.
+		 * \return  The phase timings of the last simulation step, zero unless timed phases are enabled.
+		 */
+		const PhaseTimings &getPhaseTimings() const;
+
+		/**
+		 * \brief   Returns whether the neighbors of all agents are computed in a single dual-tree traversal.
+		 * \return  True if the dual-tree neighbor search is enabled.
+		 */
+		bool getDualTreeNeighborSearch() const;
+
+		/**
+		 * \brief   Returns whether ORCA planes are computed once per mutual pair of neighbors.
+		 * \return  True if the shared ORCA plane phase is enabled.
+		 */
+		bool getSharedORCAPlanes() const;
+
+		/**
+		 * \brief   Returns whether neighbors that cannot collide within the time horizon are pruned.
+		 * \return  True if velocity-aware neighbor pruning is enabled.
+		 */
+		bool getVelocityPruning() const;
+
+		/**
+		 * \brief   Returns the margin added to the combined radius by velocity-aware neighbor pruning.
+		 * \return  The present velocity pruning margin.
+		 */
+		float getVelocityPruningMargin() const;
+
+		/**
+		 * \brief   Returns whether the neighbor count of each agent adapts to its local density.
+		 * \return  True if adaptive neighbor counts are enabled.
+		 */
+		bool getAdaptiveNeighbors() const;
+
+		/**
+		 * \brief   Returns whether the velocity solve of each agent is warm-started from the planes binding in its previous solve.
+		 * \return  True if warm-started solves are enabled.
+		 */
+		bool getWarmStartedSolve() const;
+
+		/**
+		 * \brief   Returns the neighbor skin of the simulation.
+		 * \return  The present neighbor skin, or zero if neighbor candidates are not cached.
+		 */
+		float getNeighborSkin() const;
+
+		/**
+		 * \brief   Returns the wall-clock time the solve phase of a simulation step may spend before deferring the remaining agents.
+		 * \return  The present time budget in seconds, or zero if unbounded.
+		 */
+		float getSolveTimeBudget() const;
+
+		/**
+		 * \brief   Returns the executor the parallel loops of the simulation run on.
+		 * \return  A pointer to the executor, or NULL if the loops run on the calling thread.
+		 */
+		Executor *getExecutor() const;
+
+		/**
+		 * \brief   Returns whether the phases of each simulation step are timed.
+		 * \return  True if timed phases are enabled.
+		 */
+		bool getTimedPhases() const;
+
+		/**
+		 * \brief   Returns the maximum number of agents solved per simulation step.
+		 * \return  The present maximum number of solved agents, or zero if unbounded.
+		 */
+		size_t getMaxSolvedAgents() const;
+
+		/**
+		 * \brief   Returns whether agents are solved in order of urgency.
+		 * \return  True if urgency scheduling is enabled.
+		 */
+		bool getUrgencyScheduling() const;
+
+		/**
+		 * \brief   Returns the maximum number of steps an agent is left unsolved by urgency scheduling.
+		 * \return  The present maximum number of deferred steps.
+		 */
+		size_t getMaxDeferredSteps() const;
+
 		/**
 		 * \brief   Returns the time step of the simulation.
 		 * \return  The present time step of the simulation.
@@ -211,7 +636,6 @@ namespace RVO {
 		/**
 		 * \brief   Removes an agent from the simulation.
 		 * \param   agentNo  The number of the agent that is to be removed.
-		 * \note    After the removal of the agent, the agent that previously had number getNumAgents() - 1 will now have number agentNo.
 		 */
 		void removeAgent(size_t agentNo);
 
@@ -226,6 +650,20 @@ namespace RVO {
 		 */
 		void setAgentDefaults(float neighborDist, size_t maxNeighbors, float timeHorizon, float radius, float maxSpeed, int avoidanceGroup = 1, int groupsToAvoid = -1, int groupsToIgnore = 0, const Vector3 &velocity = Vector3());
 
+		/**
+		 * \brief   Sets the archetype of a specified agent, discarding its overridden parameters.
+		 * \param   agentNo      The number of the agent whose archetype is to be modified.
+		 * \param   archetypeNo  The number of the replacement archetype.
+		 */
+		FORCEINLINE void setAgentArchetype(size_t agentNo, size_t archetypeNo);
+
+		/**
+		 * \brief   Sets the parameters of a specified archetype, retuning all agents that reference it.
+		 * \param   archetypeNo  The number of the archetype whose parameters are to be modified.
+		 * \param   archetype    The replacement parameters.
+		 */
+		void setArchetype(size_t archetypeNo, const AgentArchetype &archetype);
+
 		/**
 		 * \brief   Sets the maximum neighbor count of a specified agent.
 		 * \param   agentNo       The number of the agent whose maximum neighbor count is to be modified.
@@ -233,6 +671,13 @@ namespace RVO {
 		 */
 		FORCEINLINE void setAgentMaxNeighbors(size_t agentNo, size_t maxNeighbors);
 
+		/**
+		 * \brief   Sets the lower bound of the adaptive neighbor count of a specified agent.
+		 * \param   agentNo       The number of the agent whose minimum neighbor count is to be modified.
+		 * \param   minNeighbors  The replacement minimum neighbor count.
+		 */
+		FORCEINLINE void setAgentMinNeighbors(size_t agentNo, size_t minNeighbors);
+
 		/**
 		 * \brief   Sets the maximum speed of a specified agent.
 		 * \param   agentNo   The number of the agent whose maximum speed is to be modified.
@@ -247,6 +692,27 @@ namespace RVO {
 		 */
 		FORCEINLINE void setAgentNeighborDist(size_t agentNo, float neighborDist);
 
+		/**
+		 * \brief   Sets the planar mode of a specified agent.
+		 * \param   agentNo  The number of the agent whose planar mode is to be modified.
+		 * \param   planar   True if the agent keeps its height and solves for a horizontal velocity only.
+		 */
+		FORCEINLINE void setAgentPlanar(size_t agentNo, bool planar);
+
+		/**
+		 * \brief   Sets the passive mode of a specified agent. A passive agent moves on with the velocity it is given, without neighbor queries or velocity solves. Other agents avoid it without reciprocity, taking the full change in relative velocity on themselves.
+		 * \param   agentNo  The number of the agent whose passive mode is to be modified.
+		 * \param   passive  True if the agent is avoided by other agents but never solved.
+		 */
+		FORCEINLINE void setAgentPassive(size_t agentNo, bool passive);
+
+		/**
+		 * \brief   Sets the step multiple of a specified agent. The agent is solved every stepMultiple steps, times its update interval, and resolves collisions over that many steps. It moves, and is avoided by other agents at its current position, every step.
+		 * \param   agentNo       The number of the agent whose step multiple is to be modified.
+		 * \param   stepMultiple  The replacement step multiple. One solves the agent every step.
+		 */
+		FORCEINLINE void setAgentStepMultiple(size_t agentNo, size_t stepMultiple);
+
 		/**
 		 * \brief   Sets the three-dimensional position of a specified agent.
 		 * \param   agentNo   The number of the agent whose three-dimensional position is to be modified.
@@ -275,6 +741,13 @@ namespace RVO {
 		 */
 		FORCEINLINE void setAgentTimeHorizon(size_t agentNo, float timeHorizon);
 
+		/**
+		 * \brief   Sets the update interval of a specified agent. Between solves, the agent moves on with its last solved velocity, and is still avoided by other agents. Agents with the same interval are staggered across steps by their number.
+		 * \param   agentNo         The number of the agent whose update interval is to be modified.
+		 * \param   updateInterval  The number of simulation steps between two solves of the agent, applied on top of its step multiple. One solves the agent at its step multiple.
+		 */
+		FORCEINLINE void setAgentUpdateInterval(size_t agentNo, size_t updateInterval);
+
 		/**
 		 * \brief   Sets the three-dimensional linear velocity of a specified agent.
 		 * \param   agentNo   The number of the agent whose three-dimensional linear velocity is to be modified.
@@ -305,8 +778,15 @@ namespace RVO {
 
         FORCEINLINE void addAgentNeighborToIgnore(size_t agentNo, size_t ignoredNo);
         FORCEINLINE void removeAgentNeighborToIgnore(size_t agentNo, size_t ignoredNo);
-        FORCEINLINE void setAgentIgnoredNeighbors(size_t agentNo, const TArray<int>& ignoredArr);
-        FORCEINLINE void setAgentIgnoredNeighbors(size_t agentNo, const TSet<int>& ignoredSet);
+
+		/**
+		 * \brief   Replaces the agents an agent leaves out of its neighbors.
+		 * \param   agentNo     The agent id.
+		 * \param   ignoredNos  A pointer to the ids of the agents to be ignored.
+		 * \param   count       The number of agents to be ignored.
+		 */
+        FORCEINLINE void setAgentIgnoredNeighbors(size_t agentNo, const size_t *ignoredNos, size_t count);
+
         FORCEINLINE void clearAgentIgnoredNeighbors(size_t agentNo, bool bAllowShrinking = false);
 
 		/**
@@ -316,24 +796,300 @@ namespace RVO {
 		 */
 		//FORCEINLINE void setAgentDebug(size_t agentNo, bool debug);
 
+		/**
+		 * \brief   Bounds the per-agent cost of the velocity solve.
+		 * \param   maxORCAPlanes       The maximum number of ORCA planes, nearest neighbors first, an agent takes into account. Zero if unbounded.
+		 * \param   maxSolverIterations The maximum number of 3-d linear programs an agent may solve when its constraints are infeasible. When exceeded, the least penetrating velocity found so far is kept. Zero if unbounded.
+		 */
+		void setSolverBudget(size_t maxORCAPlanes, size_t maxSolverIterations);
+
+		/**
+		 * \brief   Sets whether the neighbors of all agents are computed in a single traversal of the <i>k</i>d-tree against itself, instead of one query per agent. Each pair of agents is then visited once.
+		 * \param   dualTree  True to enable the dual-tree neighbor search.
+		 */
+		void setDualTreeNeighborSearch(bool dualTree);
+
+		/**
+		 * \brief   Sets whether ORCA planes are computed once per mutual pair of neighbors with equal time horizons, each agent receiving the mirrored plane of the other.
+		 * \param   sharedPlanes  True to enable the shared ORCA plane phase.
+		 */
+		void setSharedORCAPlanes(bool sharedPlanes);
+
+		/**
+		 * \brief   Sets whether neighbor candidates whose current relative motion cannot bring them within the combined radius inside the time horizon are rejected, leaving their neighbor slot and ORCA plane to more relevant agents.
+		 * \param   velocityPruning  True to enable velocity-aware neighbor pruning.
+		 * \param   margin           The distance added to the combined radius, as a reserve for changes of velocity. Must be non-negative.
+		 */
+		void setVelocityPruning(bool velocityPruning, float margin = 0.0f);
+
+		/**
+		 * \brief   Sets whether the neighbor count of each agent adapts to its local density. The effective count follows a smoothed number of neighbors found within range, with headroom, between the minimum and maximum neighbor counts of the agent.
+		 * \param   adaptiveNeighbors  True to enable adaptive neighbor counts.
+		 * \param   smoothing          The weight of the latest step in the smoothed neighbor count, in (0, 1].
+		 * \param   headroom           The factor applied to the smoothed neighbor count. Must be greater than one for saturated agents to grow their count.
+		 */
+		void setAdaptiveNeighbors(bool adaptiveNeighbors, float smoothing = 0.25f, float headroom = 1.5f);
+
+		/**
+		 * \brief   Sets whether the velocity solve of each agent is warm-started. The ORCA planes of neighbors that bound the previous solve of the agent are tested first, which settles the incremental linear programs early in slow-changing crowds. The new velocities are unchanged up to rounding, but the neighbors of an agent are no longer ordered by distance after its solve.
+		 * \param   warmStartedSolve  True to enable warm-started solves.
+		 */
+		void setWarmStartedSolve(bool warmStartedSolve);
+
+		/**
+		 * \brief   Sets the neighbor skin of the simulation.
+		 * \param   neighborSkin  The margin added to the neighbor distance of each agent when caching its neighbor candidates. The candidates are reused, and only filtered by distance, until some agent has moved more than half the skin. Zero to query the <i>k</i>d-tree every step. Must be non-negative.
+		 */
+		void setNeighborSkin(float neighborSkin);
+
+		/**
+		 * \brief   Bounds the wall-clock time of the solve phase of a simulation step, which searches the neighbors of each agent unless already searched, solves its velocity and moves it. Agents are solved round-robin, and those left when the budget is spent keep their last solved velocity until a later step reaches them. At least one agent is solved per step.
+		 *
+		 * The passes that precede the solve phase run for all agents and are not bounded: the tree build, the neighbor searches of dual-tree search, timed phases and urgency scheduling, and the construction of shared ORCA planes.
+		 * \param   solveTimeBudget  The time budget in seconds. Zero if unbounded.
+		 */
+		void setSolveTimeBudget(float solveTimeBudget);
+
+		/**
+		 * \brief   Sets the executor the parallel loops of the simulation run on: the neighbor searches and, unless a time budget or a maximum number of solved agents orders the agents, the velocity solves. The results do not depend on the executor.
+		 * \param   executor  A pointer to the executor, which must outlive its use by the simulation, or NULL to run the loops on the calling thread.
+		 */
+		void setExecutor(Executor *executor);
+
+		/**
+		 * \brief   Sets whether the phases of each simulation step are timed. Timed steps search all neighbors before solving and move the agents after solving, instead of doing both per agent during the solve. The results are unchanged.
+		 * \param   timedPhases  True to time the phases of each simulation step.
+		 */
+		void setTimedPhases(bool timedPhases);
+
+		/**
+		 * \brief   Bounds the number of agents solved per simulation step. Agents left over keep their last solved velocity, like those left when the time budget is spent. At least one agent is solved per step.
+		 * \param   maxSolvedAgents  The maximum number of solved agents. Zero if unbounded.
+		 */
+		void setMaxSolvedAgents(size_t maxSolvedAgents);
+
+		/**
+		 * \brief   Sets whether agents are solved in order of urgency. Each step, agents are sorted by their time to collision with their current neighbors, so that a time budget or a maximum number of solved agents defers the safest agents first. Under such a bound, agents with no collision ahead within their time horizon also skip the solve and move at their clamped preferred velocity. Without one, scheduling only reorders the solves.
+		 * \param   urgencyScheduling  True to enable urgency scheduling.
+		 * \param   maxDeferredSteps   The number of steps after which an unsolved agent is solved first, regardless of its time to collision. Must be positive.
+		 */
+		void setUrgencyScheduling(bool urgencyScheduling, size_t maxDeferredSteps = 8);
+
 		/**
 		 * \brief   Sets the time step of the simulation.
 		 * \param   timeStep  The time step of the simulation. Must be positive.
 		 */
 		void setTimeStep(float timeStep);
 
+	protected:
+		/**
+		 * \brief   Performs a simulation step with the hot paths specialized for a compile-time configuration.
+		 * \tparam  Traits  The compile-time configuration, one of RVO_SIMULATOR_TRAITS.
+		 */
+		template <class Traits>
+		void doStep();
+
 	private:
+		/**
+		 * \brief   Returns the agent with an agent number, which must be in the simulation.
+		 * \param   agentNo  The number of the agent.
+		 * \return  A pointer to the agent.
+		 */
+		Agent *findAgent(size_t agentNo) const
+		{
+			const std::unordered_map<size_t, Agent *>::const_iterator iterator = agentMap_.find(agentNo);
+			assert(iterator != agentMap_.end());
+
+			return iterator->second;
+		}
+
+		/**
+		 * \brief   Defines an archetype with its reference count.
+		 */
+		class ArchetypeEntry {
+		public:
+			/**
+			 * \brief   The parameters of the archetype.
+			 */
+			AgentArchetype archetype;
+
+			/**
+			 * \brief   The number of agents referencing the archetype.
+			 */
+			size_t refCount;
+
+			/**
+			 * \brief   True if the archetype is the private copy of a single agent.
+			 */
+			bool isPrivate;
+
+			/**
+			 * \brief   True if the archetype was added by addArchetype, which keeps it while unreferenced.
+			 */
+			bool isPinned;
+
+			/**
+			 * \brief   True if the entry was recycled and awaits reuse.
+			 */
+			bool isFree;
+		};
+
+		/**
+		 * \brief   Returns the hash of the parameters of an archetype. Parameters that default on construction are left to the equality test.
+		 * \param   archetype  The parameters of the archetype.
+		 * \return  The hash of the parameters.
+		 */
+		static size_t hashArchetype(const AgentArchetype &archetype);
+
+		/**
+		 * \brief   Stores an archetype entry, reusing a recycled entry if any, and indexes it if it is shared.
+		 * \param   entry  The archetype entry.
+		 * \return  The number of the archetype.
+		 */
+		size_t insertArchetype(const ArchetypeEntry &entry);
+
+		/**
+		 * \brief   Removes a shared archetype from the index of shared archetypes.
+		 * \param   archetypeNo  The number of the archetype.
+		 */
+		void unindexArchetype(size_t archetypeNo);
+
+		/**
+		 * \brief   Makes an agent reference an archetype, releasing its previous archetype.
+		 * \param   agent        A pointer to the agent.
+		 * \param   archetypeNo  The number of the archetype.
+		 */
+		void assignArchetype(Agent *agent, size_t archetypeNo);
+
+		/**
+		 * \brief   Releases a reference to an archetype. Private archetypes, and shared archetypes not added by addArchetype, are recycled once unreferenced.
+		 * \param   archetypeNo  The number of the archetype.
+		 */
+		void releaseArchetype(size_t archetypeNo);
+
+		/**
+		 * \brief   Returns the parameters of an agent for modification, giving the agent a private copy of its archetype first if it is shared.
+		 * \param   agent  A pointer to the agent.
+		 * \return  A reference to the private parameters of the agent.
+		 */
+		AgentArchetype &overrideArchetype(Agent *agent);
+
+		/**
+		 * \brief   Checks whether the cached neighbor candidates must be recomputed.
+		 * \return  True if some agent has moved more than half the neighbor skin since the candidates were computed.
+		 */
+		bool shouldComputeNeighborCandidates() const;
+
+		/**
+		 * \brief   Computes the time to collision of each agent and sorts the agents into the solve order of the current step.
+		 */
+		void scheduleByUrgency();
+
+		/**
+		 * \brief   Solves and moves an agent, or moves it on with its last solved velocity if it is passive, safe under urgency scheduling, not due or out of budget.
+		 * \tparam  Traits            The compile-time configuration of the simulation.
+		 * \param   agent             A pointer to the agent.
+		 * \param   computeNeighbors  True if the neighbors of the agent are still to be computed.
+		 * \param   budgetSpent       True if the step has run out of budget.
+		 * \param   stats             A reference to the counters the solve is added to.
+		 * \return  True if the agent was solved.
+		 */
+		template <class Traits>
+		bool stepAgent(Agent *agent, bool computeNeighbors, bool budgetSpent, SolverStats &stats);
+
+		/**
+		 * \brief   Adds the counters of a part of the agents to the solver statistics of the step.
+		 * \param   stats  The counters to be added.
+		 */
+		void addSolverStats(const SolverStats &stats);
+
+		/**
+		 * \brief   Adds the time since the start of a phase to its timing and starts the next phase, if timed phases are enabled.
+		 * \param   phaseTime   A reference to the timing of the phase.
+		 * \param   phaseStart  A reference to the start time of the phase, set to the start of the next phase.
+		 */
+		void endPhase(float &phaseTime, std::chrono::steady_clock::time_point &phaseStart) const;
+
+		/**
+		 * \brief   Calls a function for every agent, in parallel on the executor if there is one.
+		 * \param   function  The function, which may only modify the agent it is called for.
+		 */
+		template <class Function>
+		void forEachAgent(const Function &function);
+
 		Agent *defaultAgent_;
 		KdTree *kdTree_;
 		float globalTime_;
 		float timeStep_;
+		size_t maxORCAPlanes_;
+		size_t maxSolverIterations_;
+		SolverStats solverStats_;
+		float neighborSkin_;
+		bool dualTreeNeighbors_;
+		bool sharedORCAPlanes_;
+		bool velocityPruning_;
+		bool adaptiveNeighbors_;
+		bool warmStartedSolve_;
+		float adaptiveNeighborSmoothing_;
+		float adaptiveNeighborHeadroom_;
+		float velocityPruningMargin_;
+		bool neighborCandidatesDirty_;
+		size_t stateIndex_;
+		size_t stepCount_;
+		float solveTimeBudget_;
+		size_t solveCursor_;
+		size_t maxSolvedAgents_;
+		bool urgencyScheduling_;
+		size_t maxDeferredSteps_;
+		Executor *executor_;
+		bool timedPhases_;
+		PhaseTimings phaseTimings_;
+		std::vector<std::pair<float, size_t> > solveOrder_;
 		std::vector<Agent *> agents_;
-		TMap<size_t, Agent *> agentMap_;
+		std::deque<ArchetypeEntry> archetypes_;
+		std::vector<size_t> freeArchetypes_;
+		std::unordered_multimap<size_t, size_t> archetypeIndex_;
+		std::unordered_map<size_t, Agent *> agentMap_;
         size_t agentUID_ = 0;
 
 		friend class Agent;
 		friend class KdTree;
 	};
+
+	/**
+	 * \brief   Defines a simulation specialized for a compile-time configuration.
+	 *
+	 * The configuration sets the <i>k</i>d-tree leaf size and the bound on the neighbor count, and the group mask and ignore list checks it disables are compiled out of the neighbor search. Precision and vector math are not part of it. RVO::RVOSimulator is the simulation for RVO::DefaultSimulatorTraits.
+	 * \tparam  Traits  The compile-time configuration, one of RVO_SIMULATOR_TRAITS.
+	 */
+	template <class Traits>
+	class TRVOSimulator : public RVOSimulator {
+	public:
+		/**
+		 * \brief   Constructs a simulator instance.
+		 */
+		TRVOSimulator() { }
+
+		/**
+		 * \brief   Constructs a simulator instance and sets the default properties for any new agent that is added.
+		 * \param   timeStep      The time step of the simulation. Must be positive.
+		 * \param   neighborDist  The default maximum distance (center point to center point) to other agents a new agent takes into account in the navigation. Must be non-negative.
+		 * \param   maxNeighbors  The default maximum number of other agents a new agent takes into account in the navigation.
+		 * \param   timeHorizon   The default minimum amount of time for which a new agent's velocities that are computed by the simulation are safe with respect to other agents. Must be positive.
+		 * \param   radius        The default radius of a new agent. Must be non-negative.
+		 * \param   maxSpeed      The default maximum speed of a new agent. Must be non-negative.
+		 * \param   velocity      The default initial three-dimensional linear velocity of a new agent (optional).
+		 */
+		TRVOSimulator(float timeStep, float neighborDist, size_t maxNeighbors, float timeHorizon, float radius, float maxSpeed, const Vector3 &velocity = Vector3()) : RVOSimulator(timeStep, neighborDist, maxNeighbors, timeHorizon, radius, maxSpeed, velocity) { }
+
+		/**
+		 * \brief   Lets the simulator perform a simulation step and updates the three-dimensional position and three-dimensional velocity of each agent.
+		 */
+		virtual void doStep()
+		{
+			RVOSimulator::doStep<Traits>();
+		}
+	};
 }
 
 #endif
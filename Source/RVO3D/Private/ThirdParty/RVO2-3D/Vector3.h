@@ -9,6 +9,32 @@
 #include <ostream>
 #endif
 
+/**
+ * \brief   Nonzero to implement RVO::Vector3 arithmetic with four-lane SSE instructions. The results are identical to the scalar implementation.
+ */
+#ifndef RVO_USE_SSE
+#define RVO_USE_SSE 0
+#endif
+
+/**
+ * \brief   Nonzero to normalize vectors with a reciprocal square root estimate refined by one Newton-Raphson step, instead of a square root and a division.
+ */
+#ifndef RVO_FAST_RSQRT
+#define RVO_FAST_RSQRT 0
+#endif
+
+/* Both options need SSE, so that other targets fall back to the scalar implementation and std::sqrt. */
+#if !defined(__SSE__) && !defined(_M_X64) && !defined(_M_AMD64) && !(defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#undef RVO_USE_SSE
+#define RVO_USE_SSE 0
+#undef RVO_FAST_RSQRT
+#define RVO_FAST_RSQRT 0
+#endif
+
+#if RVO_USE_SSE || RVO_FAST_RSQRT
+#include <xmmintrin.h>
+#endif
+
 namespace RVO {
 	/**
 	 * \brief  Defines a three-dimensional vector.
@@ -23,6 +49,9 @@ namespace RVO {
 			val_[0] = 0.0f;
 			val_[1] = 0.0f;
 			val_[2] = 0.0f;
+#if RVO_USE_SSE
+			val_[3] = 0.0f;
+#endif
 		}
 
 		/**
@@ -34,6 +63,9 @@ namespace RVO {
 			val_[0] = vector[0];
 			val_[1] = vector[1];
 			val_[2] = vector[2];
+#if RVO_USE_SSE
+			val_[3] = 0.0f;
+#endif
 		}
 
 		/**
@@ -45,6 +77,9 @@ namespace RVO {
 			val_[0] = val[0];
 			val_[1] = val[1];
 			val_[2] = val[2];
+#if RVO_USE_SSE
+			val_[3] = 0.0f;
+#endif
 		}
 
 		/**
@@ -58,6 +93,9 @@ namespace RVO {
 			val_[0] = x;
 			val_[1] = y;
 			val_[2] = z;
+#if RVO_USE_SSE
+			val_[3] = 0.0f;
+#endif
 		}
 
 		/**
@@ -98,7 +136,11 @@ namespace RVO {
 		 */
 		inline Vector3 operator-() const
 		{
+#if RVO_USE_SSE
+			return Vector3(_mm_sub_ps(_mm_setzero_ps(), load()));
+#else
 			return Vector3(-val_[0], -val_[1], -val_[2]);
+#endif
 		}
 
 		/**
@@ -108,7 +150,15 @@ namespace RVO {
 		 */
 		inline float operator*(const Vector3 &vector) const
 		{
+#if RVO_USE_SSE
+			/* Summed in the order of the scalar implementation. */
+			const __m128 product = _mm_mul_ps(load(), vector.load());
+			const __m128 sum = _mm_add_ss(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1)));
+
+			return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 2, 2, 2))));
+#else
 			return val_[0] * vector[0] + val_[1] * vector[1] + val_[2] * vector[2];
+#endif
 		}
 
 		/**
@@ -118,7 +168,11 @@ namespace RVO {
 		 */
 		inline Vector3 operator*(float scalar) const
 		{
+#if RVO_USE_SSE
+			return Vector3(_mm_mul_ps(load(), _mm_set1_ps(scalar)));
+#else
 			return Vector3(val_[0] * scalar, val_[1] * scalar, val_[2] * scalar);
+#endif
 		}
 
 		/**
@@ -130,7 +184,11 @@ namespace RVO {
 		{
 			const float invScalar = 1.0f / scalar;
 
+#if RVO_USE_SSE
+			return Vector3(_mm_mul_ps(load(), _mm_set1_ps(invScalar)));
+#else
 			return Vector3(val_[0] * invScalar, val_[1] * invScalar, val_[2] * invScalar);
+#endif
 		}
 
 		/**
@@ -140,7 +198,11 @@ namespace RVO {
 		 */
 		inline Vector3 operator+(const Vector3 &vector) const
 		{
+#if RVO_USE_SSE
+			return Vector3(_mm_add_ps(load(), vector.load()));
+#else
 			return Vector3(val_[0] + vector[0], val_[1] + vector[1], val_[2] + vector[2]);
+#endif
 		}
 
 		/**
@@ -150,7 +212,11 @@ namespace RVO {
 		 */
 		inline Vector3 operator-(const Vector3 &vector) const
 		{
+#if RVO_USE_SSE
+			return Vector3(_mm_sub_ps(load(), vector.load()));
+#else
 			return Vector3(val_[0] - vector[0], val_[1] - vector[1], val_[2] - vector[2]);
+#endif
 		}
 
 		/**
@@ -180,9 +246,13 @@ namespace RVO {
 		 */
 		inline Vector3 &operator*=(float scalar)
 		{
+#if RVO_USE_SSE
+			store(_mm_mul_ps(load(), _mm_set1_ps(scalar)));
+#else
 			val_[0] *= scalar;
 			val_[1] *= scalar;
 			val_[2] *= scalar;
+#endif
 
 			return *this;
 		}
@@ -196,9 +266,13 @@ namespace RVO {
 		{
 			const float invScalar = 1.0f / scalar;
 
+#if RVO_USE_SSE
+			store(_mm_mul_ps(load(), _mm_set1_ps(invScalar)));
+#else
 			val_[0] *= invScalar;
 			val_[1] *= invScalar;
 			val_[2] *= invScalar;
+#endif
 
 			return *this;
 		}
@@ -211,9 +285,13 @@ namespace RVO {
 		 */
 		inline Vector3 &operator+=(const Vector3 &vector)
 		{
+#if RVO_USE_SSE
+			store(_mm_add_ps(load(), vector.load()));
+#else
 			val_[0] += vector[0];
 			val_[1] += vector[1];
 			val_[2] += vector[2];
+#endif
 
 			return *this;
 		}
@@ -225,15 +303,47 @@ namespace RVO {
 		 */
 		inline Vector3 &operator-=(const Vector3 &vector)
 		{
+#if RVO_USE_SSE
+			store(_mm_sub_ps(load(), vector.load()));
+#else
 			val_[0] -= vector[0];
 			val_[1] -= vector[1];
 			val_[2] -= vector[2];
+#endif
 
 			return *this;
 		}
 
 	private:
+#if RVO_USE_SSE
+		/**
+		 * \brief   Constructs and initializes a three-dimensional vector from the specified four-lane register, whose fourth lane is zero.
+		 * \param   val  The four-lane register containing the xyz-coordinates.
+		 */
+		inline explicit Vector3(__m128 val)
+		{
+			store(val);
+		}
+
+		/**
+		 * \brief   Loads this three-dimensional vector into a four-lane register. The storage is not required to be aligned.
+		 * \return  The four-lane register containing the xyz-coordinates and a zero.
+		 */
+		inline __m128 load() const { return _mm_loadu_ps(val_); }
+
+		/**
+		 * \brief   Stores a four-lane register into this three-dimensional vector.
+		 * \param   val  The four-lane register containing the xyz-coordinates and a zero.
+		 */
+		inline void store(__m128 val) { _mm_storeu_ps(val_, val); }
+
+		float val_[4];
+
+		friend Vector3 operator*(float scalar, const Vector3 &vector);
+		friend Vector3 cross(const Vector3 &vector1, const Vector3 &vector2);
+#else
 		float val_[3];
+#endif
 	};
 
 
@@ -246,7 +356,11 @@ namespace RVO {
 	 */
 	inline Vector3 operator*(float scalar, const Vector3 &vector)
 	{
+#if RVO_USE_SSE
+		return Vector3(_mm_mul_ps(_mm_set1_ps(scalar), vector.load()));
+#else
 		return Vector3(scalar * vector[0], scalar * vector[1], scalar * vector[2]);
+#endif
 	}
 
 	/**
@@ -258,7 +372,18 @@ namespace RVO {
 	 */
 	inline Vector3 cross(const Vector3 &vector1, const Vector3 &vector2)
 	{
+#if RVO_USE_SSE
+		const __m128 val1 = vector1.load();
+		const __m128 val2 = vector2.load();
+		const __m128 yzx1 = _mm_shuffle_ps(val1, val1, _MM_SHUFFLE(3, 0, 2, 1));
+		const __m128 zxy1 = _mm_shuffle_ps(val1, val1, _MM_SHUFFLE(3, 1, 0, 2));
+		const __m128 yzx2 = _mm_shuffle_ps(val2, val2, _MM_SHUFFLE(3, 0, 2, 1));
+		const __m128 zxy2 = _mm_shuffle_ps(val2, val2, _MM_SHUFFLE(3, 1, 0, 2));
+
+		return Vector3(_mm_sub_ps(_mm_mul_ps(yzx1, zxy2), _mm_mul_ps(zxy1, yzx2)));
+#else
 		return Vector3(vector1[1] * vector2[2] - vector1[2] * vector2[1], vector1[2] * vector2[0] - vector1[0] * vector2[2], vector1[0] * vector2[1] - vector1[1] * vector2[0]);
+#endif
 	}
 
 #ifndef _NOIOSTREAM
@@ -307,7 +432,16 @@ namespace RVO {
 	 */
 	inline Vector3 normalize(const Vector3 &vector)
 	{
+#if RVO_FAST_RSQRT
+		const __m128 lengthSq = _mm_set_ss(absSq(vector));
+		const __m128 estimate = _mm_rsqrt_ss(lengthSq);
+		/* One Newton-Raphson step refines the 12-bit estimate to nearly full precision. */
+		const __m128 refined = _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), estimate), _mm_sub_ss(_mm_set_ss(3.0f), _mm_mul_ss(_mm_mul_ss(lengthSq, estimate), estimate)));
+
+		return vector * _mm_cvtss_f32(refined);
+#else
 		return vector / abs(vector);
+#endif
 	}
 }
 
@@ -20,6 +20,14 @@ class RVO3D_API URVO3DAgentComponent final : public UActorComponent
 	UPROPERTY(BlueprintReadOnly, Transient, Category=RVO3D)
     FVector AvoidanceVelocity;
 
+    // Velocity result of the latest RVO simulation step
+	UPROPERTY(BlueprintReadOnly, Transient, Category=RVO3D)
+    FVector StepVelocity;
+
+    // Velocity result of the RVO simulation step before the latest one. Interpolated towards StepVelocity between fixed simulation steps.
+	UPROPERTY(BlueprintReadOnly, Transient, Category=RVO3D)
+    FVector PreviousStepVelocity;
+
 	// Locked preferred velocity
 	UPROPERTY(BlueprintReadOnly, Transient, Category=RVO3D)
     float PreferredVelocityLockTimer;
@@ -37,6 +45,10 @@ class RVO3D_API URVO3DAgentComponent final : public UActorComponent
 	UPROPERTY(BlueprintReadOnly, Transient, Category=RVO3D)
     FVector GoalAdjustment;
 
+    // Simulation LOD tier of the agent, zero when solved every step
+	UPROPERTY(BlueprintReadOnly, Transient, Category=RVO3D)
+    int32 LODTier;
+
     // Agents to ignore
 	UPROPERTY(BlueprintReadOnly, Category=RVO3D)
     TSet<const URVO3DAgentComponent*> IgnoredAgents;
@@ -49,6 +61,10 @@ class RVO3D_API URVO3DAgentComponent final : public UActorComponent
     UPROPERTY(BlueprintReadWrite, EditAnywhere, Category=RVO3D)
     int32 MaxNeighbours;
 
+	// The lowest number of other agents a new agent takes into account when its simulator adapts neighbour counts to local density. Ignored otherwise.
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="1"))
+    int32 MinNeighbours;
+
 	// The default maximal distance (center point to center point) to other agents a new agent takes into account in the navigation. The larger this number, the longer he running time of the simulation. If the number is too low, the simulation will not be safe. Must be non-negative.
     UPROPERTY(BlueprintReadWrite, EditAnywhere, Category=RVO3D)
     float NeighbourDistance;
@@ -61,6 +77,18 @@ class RVO3D_API URVO3DAgentComponent final : public UActorComponent
     UPROPERTY(BlueprintReadWrite, EditAnywhere, Category=RVO3D)
     float AgentRadius;
 
+	// Keeps the agent at its height and solves for a horizontal avoidance velocity only, for ground units. Other agents are avoided where they overlap the agent's layer.
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category=RVO3D)
+    bool bPlanar;
+
+	// Number of simulation steps between two avoidance solves of the agent. Slow agents can be solved less often than fast ones, while still moving and being avoided every step.
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="1"))
+    int32 StepMultiple;
+
+	// Avoided by other agents, which take the whole avoidance on themselves, but never solved. For player pawns and scripted movers that ignore the avoidance velocity, which then follows their own velocity.
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category=RVO3D)
+    bool bPassive;
+
 	// Moving actor's group mask
     UPROPERTY(BlueprintReadWrite, EditAnywhere, Category=RVO3D, AdvancedDisplay)
 	FNavAvoidanceMask AvoidanceGroup;
@@ -135,6 +163,17 @@ public:
 	UFUNCTION(BlueprintCallable, Category="RVO3D|Agent")
 	void SetAvoidanceVelocity(const FVector& Velocity, bool bInRequireGoalAdjustment);
 
+	// Records the velocity result of a simulation step and makes it the avoidance velocity
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Agent")
+	void SetStepVelocity(const FVector& Velocity, bool bInRequireGoalAdjustment);
+
+	// Records the velocity results of the last two substeps of a frame and makes the latest one the avoidance velocity
+	void SetSubstepVelocities(const FVector& InPreviousStepVelocity, const FVector& Velocity, bool bInRequireGoalAdjustment);
+
+	// Sets the avoidance velocity between the results of the last two simulation steps, by the fraction of a step elapsed since the latest one
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Agent")
+	void InterpolateAvoidanceVelocity(float Alpha);
+
 	UFUNCTION(BlueprintCallable, Category="RVO3D|Agent")
 	void TickLockTimer(float DeltaTime);
 
@@ -189,6 +228,12 @@ public:
         return MaxNeighbours;
     }
 
+    UFUNCTION(BlueprintCallable, Category="RVO3D|Agent")
+	int32 GetMinNeighbourCount() const
+    {
+        return MinNeighbours;
+    }
+
     UFUNCTION(BlueprintCallable, Category="RVO3D|Agent")
 	float GetNeighbourDistance() const
     {
@@ -207,6 +252,24 @@ public:
         return AgentRadius;
     }
 
+    UFUNCTION(BlueprintCallable, Category="RVO3D|Agent")
+	bool IsPlanar() const
+    {
+        return bPlanar;
+    }
+
+    UFUNCTION(BlueprintCallable, Category="RVO3D|Agent")
+	int32 GetStepMultiple() const
+    {
+        return StepMultiple;
+    }
+
+    UFUNCTION(BlueprintCallable, Category="RVO3D|Agent")
+	bool IsPassive() const
+    {
+        return bPassive;
+    }
+
 	UFUNCTION(BlueprintCallable, Category="RVO3D|Agent")
 	int32 GetAvoidanceGroupMask() const {
         return AvoidanceGroup.Packed;
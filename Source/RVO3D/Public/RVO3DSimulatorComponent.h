@@ -1,14 +1,68 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Containers/Queue.h"
+#include "Engine/EngineBaseTypes.h"
 #include "RVO3DSimulatorComponent.generated.h"
 
 namespace RVO
 {
+    class Executor;
     class RVOSimulator;
+    class Vector3;
 }
 
 class URVO3DAgentComponent;
+class URVO3DSimulatorComponent;
+
+/**
+ * Tick function passing the results of the simulation steps to the agents. Agent movement ticks after it.
+ */
+USTRUCT()
+struct FRVO3DSimulationResultsTickFunction : public FTickFunction
+{
+    GENERATED_BODY()
+
+    // Simulator whose results are passed to its agents
+    URVO3DSimulatorComponent* Target;
+
+    FRVO3DSimulationResultsTickFunction() : Target(nullptr) {}
+
+    virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+    virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FRVO3DSimulationResultsTickFunction> : public TStructOpsTypeTraitsBase2<FRVO3DSimulationResultsTickFunction>
+{
+    enum
+    {
+        WithCopy = false
+    };
+};
+
+/**
+ * Simulation level of detail applied to agents beyond a distance from the viewers
+ */
+USTRUCT(BlueprintType)
+struct FRVO3DLODTier
+{
+    GENERATED_BODY()
+
+    // Distance from the nearest viewer beyond which agents use this tier
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=RVO3D, meta=(ClampMin="0.0"))
+    float Distance;
+
+    // Number of simulation steps between two solves of agents in this tier. Agents move on with their last avoidance velocity in between.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=RVO3D, meta=(ClampMin="1"))
+    int32 UpdateInterval;
+
+    FRVO3DLODTier() : Distance(0.f), UpdateInterval(1) {}
+};
+
+// Returns the LOD tier of an agent, zero for full rate and N for the Nth entry of the simulator's LOD tiers
+DECLARE_DYNAMIC_DELEGATE_RetVal_OneParam(int32, FRVO3DAgentLODDelegate, const URVO3DAgentComponent*, AgentComponent);
 
 /** 
  * RVO3D Simulator actor component. This component coordinates a pool of RVO3D agents 
@@ -18,9 +72,31 @@ class RVO3D_API URVO3DSimulatorComponent final : public UActorComponent
 {
 	GENERATED_UCLASS_BODY()
 
-    TSharedPtr<RVO::RVOSimulator> Simulator;
+    // Thread-safe, as the step running in the background in async mode holds a reference too
+    TSharedPtr<RVO::RVOSimulator, ESPMode::ThreadSafe> Simulator;
+
+    // Task graph executor the simulator spreads its per-agent loops over in parallel mode
+    TSharedPtr<RVO::Executor> Executor;
     TMap<URVO3DAgentComponent*, int32> AgentMap;
 
+    // Simulation step running in the background in async mode
+    FGraphEventRef SimulationTask;
+
+    // Waits for the step of the previous tick in async mode, or follows the primary tick in sync mode, and passes the results to the agents
+    FRVO3DSimulationResultsTickFunction ResultsTick;
+
+    // Frame time not yet simulated in fixed timestep mode
+    float TimeAccumulator;
+
+    // Number of steps of the latest launch, whose results are applied by ApplySimulationResults
+    int32 LaunchedSteps;
+
+    // Significance callback replacing the viewer distance in simulation LOD
+    FRVO3DAgentLODDelegate AgentLODDelegate;
+
+    // Agent mutations pushed from any thread, applied on the game thread at the start of the next tick
+    TQueue<TFunction<void()>, EQueueMode::Mpsc> CommandQueue;
+
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D)
     float LockTimeAfterAvoid;
 
@@ -30,9 +106,119 @@ class RVO3D_API URVO3DSimulatorComponent final : public UActorComponent
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D)
     float GoalAdjustmentAngleOffset;
 
+	// Maximum number of nearest neighbour constraints an agent takes into account when solving its velocity. Zero for unbounded.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="0"))
+    int32 MaxORCAPlanes;
+
+	// Maximum number of fallback solver iterations an agent may run when its constraints are infeasible. The least penetrating velocity found so far is used when exceeded. Zero for unbounded.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="0"))
+    int32 MaxSolverIterations;
+
+	// Margin added to each agent's neighbour distance when caching neighbour candidates. Candidates are reused until some agent has moved more than half this distance. Zero to search neighbours every step.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="0.0"))
+    float NeighbourSkin;
+
+	// Computes the neighbours of all agents in a single traversal of the agent tree against itself, visiting each pair of agents once
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bDualTreeNeighbourSearch;
+
+	// Computes avoidance constraints once per mutual pair of neighbours with equal time horizons, and hands each agent its mirrored constraint
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bSharedPairConstraints;
+
+	// Tests the constraints of neighbours that bound an agent's previous solve first, so that the solver settles early in slow-moving crowds
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bWarmStartedSolve;
+
+	// Rejects neighbours whose current relative motion cannot bring them within the combined radius inside the agent's time horizon
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bVelocityNeighbourPruning;
+
+	// Distance added to the combined radius by velocity neighbour pruning, as a reserve for changes of velocity
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="0.0", EditCondition="bVelocityNeighbourPruning"))
+    float VelocityPruningMargin;
+
+	// Adapts each agent's neighbour count to its local density, between the agent's MinNeighbours and MaxNeighbours
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bAdaptiveNeighbours;
+
+	// Weight of the latest step in the smoothed count of neighbours found within range
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="0.01", ClampMax="1.0", EditCondition="bAdaptiveNeighbours"))
+    float AdaptiveNeighbourSmoothing;
+
+	// Factor applied to the smoothed count of neighbours found within range. Must be greater than one for crowded agents to raise their neighbour count.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="1.0", EditCondition="bAdaptiveNeighbours"))
+    float AdaptiveNeighbourHeadroom;
+
+	// Origin of the simulator's local coordinates. Agent locations are passed to the simulator relative to it, which keeps the solver precise far from the world origin.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    FIntVector SimulationOrigin;
+
+	// Moves the simulation origin to the centre of the agents once the centre is farther than RebaseDistance from it
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bAutoRebaseOrigin;
+
+	// Distance of the agents' centre from the simulation origin that triggers an automatic rebase
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="0.0", EditCondition="bAutoRebaseOrigin"))
+    float RebaseDistance;
+
+	// Runs the simulation step as a background task overlapping the rest of the frame. Agents receive the avoidance velocities of each step on the following tick.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bAsyncSimulation;
+
+	// Spreads the neighbour searches and velocity solves of each step over the task graph workers. The results are the same as on a single thread. A solve time budget or MaxSolvedAgents keeps the solves on one thread, as they are taken in order.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bParallelSimulation;
+
+	// Simulates in steps of FixedTimeStep, independent of the frame rate. Agent avoidance velocities are interpolated between steps.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bFixedTimeStep;
+
+	// Duration of a fixed simulation step, in seconds
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="0.001", EditCondition="bFixedTimeStep"))
+    float FixedTimeStep;
+
+	// Maximum number of fixed simulation steps run in a single frame. Frame time beyond it is dropped.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="1", EditCondition="bFixedTimeStep"))
+    int32 MaxSubsteps;
+
+	// Solves agents far from every viewer less often, by the LOD tiers. Agents are still avoided by nearby agents between their solves.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bSimulationLOD;
+
+	// LOD tiers by increasing distance. Agents nearer than the first tier are solved every step.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(EditCondition="bSimulationLOD"))
+    TArray<FRVO3DLODTier> LODTiers;
+
+	// Wall-clock time in milliseconds the velocity solves may spend per frame. Agents are solved round-robin, or by urgency, until it is spent, and the others keep their last avoidance velocity. The tree build and the neighbour passes run for all agents before the solves and are not bounded. Zero for unbounded.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="0.0"))
+    float SolveTimeBudget;
+
+	// Maximum number of agents solved per simulation step. The others keep their last avoidance velocity. Zero for unbounded.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="0"))
+    int32 MaxSolvedAgents;
+
+	// Solves agents in order of their time to collision, so that a solve time budget or MaxSolvedAgents defers the safest agents first. Under such a bound, agents with no collision ahead within their time horizon also skip the solve and move at their preferred velocity.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay)
+    bool bUrgencyScheduling;
+
+	// Number of simulation steps after which an unsolved agent is solved first, whatever its time to collision
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=RVO3D, AdvancedDisplay, meta=(ClampMin="1", EditCondition="bUrgencyScheduling"))
+    int32 MaxDeferredSteps;
+
+	// Number of agents that kept their last avoidance velocity in the latest simulation step
+	UPROPERTY(BlueprintReadOnly, Transient, Category=RVO3D)
+    int32 DeferredAgents;
+
+	// Largest number of simulation steps since a deferred agent was last solved. Shows how far a solve time budget leaves the simulation behind.
+	UPROPERTY(BlueprintReadOnly, Transient, Category=RVO3D)
+    int32 MaxSolveAge;
+
 	virtual void BeginPlay() override;
 	virtual void EndPlay(EEndPlayReason::Type EndPlayReason) override;
 	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction) override;
+	virtual void RegisterComponentTickFunctions(bool bRegister) override;
+	virtual void ApplyWorldOffset(const FVector& InOffset, bool bWorldShift) override;
 
     UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
     void AddAgentActor(AActor* AgentActor);
@@ -46,9 +232,27 @@ class RVO3D_API URVO3DSimulatorComponent final : public UActorComponent
     UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
     void RemoveAgentComponent(URVO3DAgentComponent* AgentComponent);
 
+	// Moves the agent to the archetype matching its current parameters, leaving other agents unchanged
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void UpdateAgentParameters(const URVO3DAgentComponent* AgentComponent);
+
+	// Retunes the archetype of the agent to its current parameters, applying them to every agent sharing the archetype
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void UpdateAgentArchetype(const URVO3DAgentComponent* AgentComponent);
+
 	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
     void UpdateIgnoredAgents(const URVO3DAgentComponent* AgentComponent);
 
+    // Queues a command from any thread. Queued commands run in one batch on the game thread at the start of the next tick, while no simulation step is running, and may call any mutator of the simulator.
+    void EnqueueCommand(TFunction<void()>&& Command);
+
+    // Thread-safe counterparts of the agent mutations, applied with the next batch of queued commands. Agents destroyed in the meantime are skipped.
+    void EnqueueAddAgentComponent(URVO3DAgentComponent* AgentComponent);
+    void EnqueueRemoveAgentComponent(URVO3DAgentComponent* AgentComponent);
+    void EnqueueUpdateAgentParameters(const URVO3DAgentComponent* AgentComponent);
+    void EnqueueAddIgnoredAgent(const URVO3DAgentComponent* AgentComponent, const URVO3DAgentComponent* IgnoredAgent);
+    void EnqueueRemoveIgnoredAgent(const URVO3DAgentComponent* AgentComponent, const URVO3DAgentComponent* IgnoredAgent);
+
 	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
     void AddIgnoredAgent(const URVO3DAgentComponent* AgentComponent, const URVO3DAgentComponent* IgnoredAgent);
 
@@ -58,6 +262,80 @@ class RVO3D_API URVO3DSimulatorComponent final : public UActorComponent
 	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
     void ClearIgnoredAgents(const URVO3DAgentComponent* AgentComponent, bool bAllowShrinking = false);
 
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetAsyncSimulation(bool bInAsyncSimulation);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetParallelSimulation(bool bInParallelSimulation);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetFixedTimeStep(bool bInFixedTimeStep, float InFixedTimeStep = .0333333f, int32 InMaxSubsteps = 4);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetSolveTimeBudget(float InSolveTimeBudget);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetMaxSolvedAgents(int32 InMaxSolvedAgents);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetUrgencyScheduling(bool bInUrgencyScheduling, int32 InMaxDeferredSteps = 8);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetSimulationLOD(bool bInSimulationLOD);
+
+	// Replaces the viewer distance with a callback choosing the LOD tier of each agent. An unbound delegate restores the viewer distance.
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetAgentLODDelegate(const FRVO3DAgentLODDelegate& InAgentLODDelegate);
+
+	// Blocks until the simulation step running in the background, if any, has completed
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void WaitForSimulation();
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetSimulationOrigin(const FIntVector& InSimulationOrigin);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetSolverBudget(int32 InMaxORCAPlanes, int32 InMaxSolverIterations);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetNeighbourSkin(float InNeighbourSkin);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetDualTreeNeighbourSearch(bool bInDualTreeNeighbourSearch);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetSharedPairConstraints(bool bInSharedPairConstraints);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetWarmStartedSolve(bool bInWarmStartedSolve);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetVelocityNeighbourPruning(bool bInVelocityNeighbourPruning, float InVelocityPruningMargin);
+
+	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
+    void SetAdaptiveNeighbours(bool bInAdaptiveNeighbours, float InSmoothing = .25f, float InHeadroom = 1.5f);
+
+    // Converts a world location to the simulator's local coordinates
+    RVO::Vector3 ToSimulationLocation(const FVector& Location) const;
+
+    // Passes the velocities computed by the last simulation step to the agents
+    void ApplySimulationResults();
+
+    // Waits for the step running in the background, if any, and passes its results to the agents
+    void ConsumeSimulationTask();
+
+    // Ticks the results tick function: consumes the async step of the previous tick, then updates the avoidance velocities and locks of the agents for the frame
+    void TickSimulationResults(float DeltaTime);
+
+    // Sync mode steps in the primary tick, which the results tick follows. Async mode consumes the previous step in the results tick, and launches the next step after movement, from the primary tick moved to TG_PostPhysics.
+    void UpdateTickDependencies();
+
+    // Runs the commands queued since the last tick, in the order they were queued by each thread
+    void ApplyQueuedCommands();
+
+    // Moves an agent to the LOD tier for its significance or its distance from the nearest viewer
+    void UpdateAgentLOD(URVO3DAgentComponent* AgentComponent, int32 AgentID, const FVector& Position, const TArray<FVector>& ViewLocations);
+
 	UFUNCTION(BlueprintCallable, Category="RVO3D|Simulator")
 	bool HasSimulator() const
 	{
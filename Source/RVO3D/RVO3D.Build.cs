@@ -17,6 +17,14 @@ public class RVO3D: ModuleRules
 
 		PrivateDependencyModuleNames.AddRange(new string[] { });
 
+        // Math options of the avoidance core, see Vector3.h. The SSE vectors give results identical to the scalar ones, the fast reciprocal square root does not.
+        // SSE is only available on x86 targets. ARM targets such as Apple Silicon, Android and consoles without <xmmintrin.h> use the scalar vectors.
+        bool bX86Target = Target.Platform == UnrealTargetPlatform.Win64 || Target.Platform == UnrealTargetPlatform.Win32
+            || (Target.Platform == UnrealTargetPlatform.Linux && Target.Architecture.StartsWith("x86_64"))
+            || (Target.Platform == UnrealTargetPlatform.Mac && !Target.Architecture.Contains("arm"));
+        PrivateDefinitions.Add(bX86Target ? "RVO_USE_SSE=1" : "RVO_USE_SSE=0");
+        PrivateDefinitions.Add("RVO_FAST_RSQRT=0");
+
         PrivateIncludePaths.AddRange(
             new string[] {
                 Path.Combine(ModuleDirectory, "Private/ThirdParty/RVO2-3D"),
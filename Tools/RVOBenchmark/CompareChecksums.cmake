@@ -0,0 +1,63 @@
+# Runs two builds of the benchmark on the same scenarios and fails if their checksums differ by more than a relative tolerance.
+# Usage: cmake -DBENCHMARK=<path> -DSCALAR_BENCHMARK=<path> -P CompareChecksums.cmake
+
+cmake_minimum_required(VERSION 3.10)
+
+set(RVO_ARGS --agents 1000 --steps 20 --warmup 0)
+
+foreach(RVO_BUILD BENCHMARK SCALAR_BENCHMARK)
+	execute_process(COMMAND ${${RVO_BUILD}} ${RVO_ARGS} OUTPUT_VARIABLE RVO_OUTPUT RESULT_VARIABLE RVO_RESULT)
+
+	if(NOT RVO_RESULT EQUAL 0)
+		message(FATAL_ERROR "${${RVO_BUILD}} failed: ${RVO_RESULT}")
+	endif()
+
+	string(STRIP "${RVO_OUTPUT}" RVO_OUTPUT)
+	string(REPLACE "\n" ";" RVO_LINES "${RVO_OUTPUT}")
+	list(REMOVE_AT RVO_LINES 0)
+	set(${RVO_BUILD}_LINES ${RVO_LINES})
+endforeach()
+
+list(LENGTH BENCHMARK_LINES RVO_COUNT)
+list(LENGTH SCALAR_BENCHMARK_LINES RVO_SCALAR_COUNT)
+
+if(NOT RVO_COUNT EQUAL RVO_SCALAR_COUNT OR RVO_COUNT EQUAL 0)
+	message(FATAL_ERROR "Expected the same records from both builds")
+endif()
+
+math(EXPR RVO_LAST "${RVO_COUNT} - 1")
+
+foreach(RVO_INDEX RANGE ${RVO_LAST})
+	list(GET BENCHMARK_LINES ${RVO_INDEX} RVO_LINE)
+	list(GET SCALAR_BENCHMARK_LINES ${RVO_INDEX} RVO_SCALAR_LINE)
+
+	string(REPLACE "," ";" RVO_FIELDS "${RVO_LINE}")
+	string(REPLACE "," ";" RVO_SCALAR_FIELDS "${RVO_SCALAR_LINE}")
+	list(GET RVO_FIELDS 0 RVO_SCENARIO)
+	list(GET RVO_FIELDS -1 RVO_CHECKSUM)
+	list(GET RVO_SCALAR_FIELDS -1 RVO_SCALAR_CHECKSUM)
+
+	# Checksums are printed with four decimals, so removing the point gives integers in units of 0.0001 for CMake's integer math.
+	string(REPLACE "." "" RVO_VALUE "${RVO_CHECKSUM}")
+	string(REPLACE "." "" RVO_SCALAR_VALUE "${RVO_SCALAR_CHECKSUM}")
+	string(REGEX REPLACE "^(-?)0+([0-9])" "\\1\\2" RVO_VALUE "${RVO_VALUE}")
+	string(REGEX REPLACE "^(-?)0+([0-9])" "\\1\\2" RVO_SCALAR_VALUE "${RVO_SCALAR_VALUE}")
+	math(EXPR RVO_DIFFERENCE "${RVO_VALUE} - ${RVO_SCALAR_VALUE}")
+
+	if(RVO_DIFFERENCE LESS 0)
+		math(EXPR RVO_DIFFERENCE "-${RVO_DIFFERENCE}")
+	endif()
+
+	if(RVO_VALUE LESS 0)
+		math(EXPR RVO_VALUE "-${RVO_VALUE}")
+	endif()
+
+	# A relative tolerance of 1e-6, and at least 0.001.
+	math(EXPR RVO_TOLERANCE "${RVO_VALUE} / 1000000 + 10")
+
+	if(RVO_DIFFERENCE GREATER RVO_TOLERANCE)
+		message(FATAL_ERROR "${RVO_SCENARIO}: checksum ${RVO_CHECKSUM} with SSE, ${RVO_SCALAR_CHECKSUM} scalar")
+	endif()
+
+	message(STATUS "${RVO_SCENARIO}: checksum ${RVO_CHECKSUM} with SSE, ${RVO_SCALAR_CHECKSUM} scalar")
+endforeach()
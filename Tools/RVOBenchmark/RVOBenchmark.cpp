@@ -0,0 +1,366 @@
+/*
+ * RVOBenchmark.cpp
+ *
+ * Times the simulation steps of the avoidance core on standard scenarios, outside the engine.
+ *
+ * Each run prints one record per scenario and agent count, with the mean wall-clock time per step of each phase in milliseconds and a checksum of the final agent positions. Records are written as CSV with a fixed header, or as one JSON object per line. Changes that must not alter the simulation keep the checksum.
+ *
+ * Usage: RVOBenchmark [options]
+ *   --scenarios LIST     Comma-separated scenarios among sphere, swarm, corridor and airspace (default: all).
+ *   --agents LIST        Comma-separated agent counts (default: 1000,10000,100000).
+ *   --steps N            Timed steps per run (default: 20).
+ *   --warmup N           Untimed steps before the timed ones (default: 5).
+ *   --threads N          Threads of the executor, 0 for the number of hardware threads (default: 1).
+ *   --seed N             Seed of the random placements (default: 1).
+ *   --format csv|json    Output format (default: csv).
+ *   --neighbor-skin X    Neighbor skin width.
+ *   --dual-tree          Search neighbors in a single dual-tree traversal.
+ *   --shared-planes      Compute ORCA planes once per mutual pair.
+ *   --warm-start         Warm-start the solve from the previously binding planes.
+ *   --adaptive           Adapt neighbor counts to the local density.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "RVO.h"
+
+namespace {
+	const float Pi = 3.14159265358979f;
+
+	/* Agent parameters of the sphere example of RVO2-3D. */
+	const float TimeStep = 0.125f;
+	const float NeighborDist = 15.0f;
+	const size_t MaxNeighbors = 10;
+	const float TimeHorizon = 10.0f;
+	const float Radius = 1.5f;
+	const float MaxSpeed = 2.0f;
+
+	/**
+	 * \brief   Defines the options of a benchmark run.
+	 */
+	struct Options {
+		Options() : steps(20), warmup(5), threads(1), seed(1), json(false), neighborSkin(0.0f), dualTree(false), sharedPlanes(false), warmStart(false), adaptive(false) { }
+
+		std::vector<std::string> scenarios;
+		std::vector<size_t> agentCounts;
+		size_t steps;
+		size_t warmup;
+		size_t threads;
+		unsigned int seed;
+		bool json;
+		float neighborSkin;
+		bool dualTree;
+		bool sharedPlanes;
+		bool warmStart;
+		bool adaptive;
+	};
+
+	/**
+	 * \brief   Defines the accumulated timings of a run, in seconds.
+	 */
+	struct RunTimings {
+		RunTimings() : buildTree(0.0), neighbors(0.0), solve(0.0), update(0.0), step(0.0), minStep(1.0e30) { }
+
+		double buildTree;
+		double neighbors;
+		double solve;
+		double update;
+		double step;
+		double minStep;
+	};
+
+	/**
+	 * \brief   Defines a small deterministic random number generator, so that placements do not depend on the standard library.
+	 */
+	class Random {
+	public:
+		explicit Random(unsigned int seed) : state_(seed * 2654435761u + 1u) { }
+
+		/**
+		 * \brief   Returns a uniform random float in [min, max).
+		 */
+		float uniform(float min, float max)
+		{
+			state_ = state_ * 1664525u + 1013904223u;
+			return min + (max - min) * static_cast<float>(state_ >> 8) / 16777216.0f;
+		}
+
+	private:
+		unsigned int state_;
+	};
+
+	std::vector<std::string> split(const std::string &list)
+	{
+		std::vector<std::string> items;
+		std::stringstream stream(list);
+		std::string item;
+
+		while (std::getline(stream, item, ',')) {
+			if (!item.empty()) {
+				items.push_back(item);
+			}
+		}
+
+		return items;
+	}
+
+	/**
+	 * \brief   Places the agents of a scenario and returns their ids and goals.
+	 * \return  False if the scenario is unknown.
+	 */
+	bool setupScenario(const std::string &scenario, size_t numAgents, unsigned int seed, RVO::RVOSimulator &sim, std::vector<size_t> &agentIDs, std::vector<RVO::Vector3> &goals)
+	{
+		Random random(seed);
+		agentIDs.reserve(numAgents);
+		goals.reserve(numAgents);
+
+		if (scenario == "sphere") {
+			/* Agents spread evenly over a sphere swap with their antipodes, so all paths cross at the center. */
+			const float sphereRadius = 2.0f * Radius * std::sqrt(static_cast<float>(numAgents) / Pi);
+
+			for (size_t i = 0; i < numAgents; ++i) {
+				const float z = 1.0f - 2.0f * (static_cast<float>(i) + 0.5f) / static_cast<float>(numAgents);
+				const float ring = std::sqrt(std::max(1.0f - z * z, 0.0f));
+				const float angle = static_cast<float>(i) * 2.39996323f;
+				const RVO::Vector3 position = sphereRadius * RVO::Vector3(ring * std::cos(angle), ring * std::sin(angle), z);
+
+				agentIDs.push_back(sim.addAgent(position));
+				goals.push_back(-position);
+			}
+		}
+		else if (scenario == "swarm") {
+			/* A dense cube of agents contracts to its center. */
+			const float side = std::cbrt(static_cast<float>(numAgents)) * 2.5f * Radius;
+
+			for (size_t i = 0; i < numAgents; ++i) {
+				agentIDs.push_back(sim.addAgent(RVO::Vector3(random.uniform(-side, side), random.uniform(-side, side), random.uniform(-side, side)) * 0.5f));
+				goals.push_back(RVO::Vector3());
+			}
+		}
+		else if (scenario == "corridor") {
+			/* Two square corridors cross at the origin, each carrying half of the agents through the intersection. */
+			const float width = std::cbrt(static_cast<float>(numAgents) * 0.5f * std::pow(3.0f * Radius, 3.0f) / 4.0f);
+			const float length = 4.0f * width;
+
+			for (size_t i = 0; i < numAgents; ++i) {
+				const float along = random.uniform(-length, 0.0f) - 0.5f * width;
+				const float across = random.uniform(-0.5f * width, 0.5f * width);
+				const float up = random.uniform(-0.5f * width, 0.5f * width);
+
+				if (i % 2 == 0) {
+					agentIDs.push_back(sim.addAgent(RVO::Vector3(along, across, up)));
+					goals.push_back(RVO::Vector3(along + length + width, across, up));
+				}
+				else {
+					agentIDs.push_back(sim.addAgent(RVO::Vector3(across, along, up)));
+					goals.push_back(RVO::Vector3(across, along + length + width, up));
+				}
+			}
+		}
+		else if (scenario == "airspace") {
+			/* Sparse traffic between random points of a large volume. */
+			const float side = std::cbrt(static_cast<float>(numAgents)) * 8.0f * Radius;
+
+			for (size_t i = 0; i < numAgents; ++i) {
+				agentIDs.push_back(sim.addAgent(RVO::Vector3(random.uniform(0.0f, side), random.uniform(0.0f, side), random.uniform(0.0f, side))));
+				goals.push_back(RVO::Vector3(random.uniform(0.0f, side), random.uniform(0.0f, side), random.uniform(0.0f, side)));
+			}
+		}
+		else {
+			return false;
+		}
+
+		return true;
+	}
+
+	void setPreferredVelocities(RVO::RVOSimulator &sim, const std::vector<size_t> &agentIDs, const std::vector<RVO::Vector3> &goals)
+	{
+		for (size_t i = 0; i < agentIDs.size(); ++i) {
+			RVO::Vector3 goalVector = goals[i] - sim.getAgentPosition(agentIDs[i]);
+
+			if (RVO::absSq(goalVector) > MaxSpeed * MaxSpeed) {
+				goalVector = RVO::normalize(goalVector) * MaxSpeed;
+			}
+
+			sim.setAgentPrefVelocity(agentIDs[i], goalVector);
+		}
+	}
+
+	bool parseOptions(int argc, char **argv, Options &options)
+	{
+		for (int i = 1; i < argc; ++i) {
+			const std::string arg = argv[i];
+			const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+			if (arg == "--dual-tree") {
+				options.dualTree = true;
+			}
+			else if (arg == "--shared-planes") {
+				options.sharedPlanes = true;
+			}
+			else if (arg == "--warm-start") {
+				options.warmStart = true;
+			}
+			else if (arg == "--adaptive") {
+				options.adaptive = true;
+			}
+			else if (value == NULL) {
+				std::fprintf(stderr, "Unknown or incomplete option %s\n", arg.c_str());
+				return false;
+			}
+			else {
+				++i;
+
+				if (arg == "--scenarios") {
+					options.scenarios = split(value);
+				}
+				else if (arg == "--agents") {
+					const std::vector<std::string> counts = split(value);
+					options.agentCounts.clear();
+
+					for (size_t j = 0; j < counts.size(); ++j) {
+						options.agentCounts.push_back(static_cast<size_t>(std::strtoul(counts[j].c_str(), NULL, 10)));
+					}
+				}
+				else if (arg == "--steps") {
+					options.steps = std::max<size_t>(std::strtoul(value, NULL, 10), 1);
+				}
+				else if (arg == "--warmup") {
+					options.warmup = std::strtoul(value, NULL, 10);
+				}
+				else if (arg == "--threads") {
+					options.threads = std::strtoul(value, NULL, 10);
+				}
+				else if (arg == "--seed") {
+					options.seed = static_cast<unsigned int>(std::strtoul(value, NULL, 10));
+				}
+				else if (arg == "--format" && (std::strcmp(value, "csv") == 0 || std::strcmp(value, "json") == 0)) {
+					options.json = std::strcmp(value, "json") == 0;
+				}
+				else if (arg == "--neighbor-skin") {
+					options.neighborSkin = static_cast<float>(std::atof(value));
+				}
+				else {
+					std::fprintf(stderr, "Unknown option %s %s\n", arg.c_str(), value);
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	void printRecord(const Options &options, const std::string &scenario, size_t numAgents, size_t numThreads, const RunTimings &timings, double checksum)
+	{
+		const double scale = 1000.0 / static_cast<double>(options.steps);
+
+		if (options.json) {
+			std::printf("{\"scenario\":\"%s\",\"agents\":%lu,\"threads\":%lu,\"steps\":%lu,\"build_tree_ms\":%.4f,\"neighbors_ms\":%.4f,\"solve_ms\":%.4f,\"update_ms\":%.4f,\"step_ms\":%.4f,\"min_step_ms\":%.4f,\"checksum\":%.4f}\n",
+				scenario.c_str(), static_cast<unsigned long>(numAgents), static_cast<unsigned long>(numThreads), static_cast<unsigned long>(options.steps),
+				timings.buildTree * scale, timings.neighbors * scale, timings.solve * scale, timings.update * scale, timings.step * scale, timings.minStep * 1000.0, checksum);
+		}
+		else {
+			std::printf("%s,%lu,%lu,%lu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+				scenario.c_str(), static_cast<unsigned long>(numAgents), static_cast<unsigned long>(numThreads), static_cast<unsigned long>(options.steps),
+				timings.buildTree * scale, timings.neighbors * scale, timings.solve * scale, timings.update * scale, timings.step * scale, timings.minStep * 1000.0, checksum);
+		}
+
+		std::fflush(stdout);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+
+	if (!parseOptions(argc, argv, options)) {
+		return 1;
+	}
+
+	if (options.scenarios.empty()) {
+		options.scenarios = split("sphere,swarm,corridor,airspace");
+	}
+
+	if (options.agentCounts.empty()) {
+		options.agentCounts.push_back(1000);
+		options.agentCounts.push_back(10000);
+		options.agentCounts.push_back(100000);
+	}
+
+	std::unique_ptr<RVO::Executor> executor;
+
+	if (options.threads != 1) {
+		executor.reset(new RVO::ThreadPoolExecutor(options.threads));
+	}
+
+	const size_t numThreads = executor ? executor->getNumThreads() : 1;
+
+	if (!options.json) {
+		std::printf("scenario,agents,threads,steps,build_tree_ms,neighbors_ms,solve_ms,update_ms,step_ms,min_step_ms,checksum\n");
+	}
+
+	for (size_t s = 0; s < options.scenarios.size(); ++s) {
+		for (size_t n = 0; n < options.agentCounts.size(); ++n) {
+			RVO::RVOSimulator sim;
+			std::vector<size_t> agentIDs;
+			std::vector<RVO::Vector3> goals;
+
+			sim.setTimeStep(TimeStep);
+			sim.setAgentDefaults(NeighborDist, MaxNeighbors, TimeHorizon, Radius, MaxSpeed);
+
+			if (!setupScenario(options.scenarios[s], options.agentCounts[n], options.seed, sim, agentIDs, goals)) {
+				std::fprintf(stderr, "Unknown scenario %s\n", options.scenarios[s].c_str());
+				return 1;
+			}
+
+			sim.setExecutor(executor.get());
+			sim.setTimedPhases(true);
+			sim.setNeighborSkin(options.neighborSkin);
+			sim.setDualTreeNeighborSearch(options.dualTree);
+			sim.setSharedORCAPlanes(options.sharedPlanes);
+			sim.setWarmStartedSolve(options.warmStart);
+			sim.setAdaptiveNeighbors(options.adaptive);
+
+			RunTimings timings;
+
+			for (size_t step = 0; step < options.warmup + options.steps; ++step) {
+				setPreferredVelocities(sim, agentIDs, goals);
+
+				const std::chrono::steady_clock::time_point stepStart = std::chrono::steady_clock::now();
+				sim.doStep();
+				const double stepTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count();
+
+				if (step >= options.warmup) {
+					const RVO::PhaseTimings &phaseTimings = sim.getPhaseTimings();
+
+					timings.buildTree += phaseTimings.buildTree;
+					timings.neighbors += phaseTimings.neighbors;
+					timings.solve += phaseTimings.solve;
+					timings.update += phaseTimings.update;
+					timings.step += stepTime;
+					timings.minStep = std::min(timings.minStep, stepTime);
+				}
+			}
+
+			double checksum = 0.0;
+
+			for (size_t i = 0; i < agentIDs.size(); ++i) {
+				const RVO::Vector3 &position = sim.getAgentPosition(agentIDs[i]);
+				checksum += position.x() + 3.0 * position.y() + 7.0 * position.z();
+			}
+
+			printRecord(options, options.scenarios[s], options.agentCounts[n], numThreads, timings, checksum);
+		}
+	}
+
+	return 0;
+}
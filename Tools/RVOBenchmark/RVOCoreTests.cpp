@@ -0,0 +1,381 @@
+/*
+ * RVOCoreTests.cpp
+ *
+ * Regression tests of the avoidance core, run through CTest. Each test is selected by name on the command line and returns nonzero on failure.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "RVO.h"
+
+namespace {
+	/**
+	 * \brief   Adds a jittered grid of agents, so that every agent has the same few neighbors at rest.
+	 * \return  The ids of the agents.
+	 */
+	std::vector<size_t> addAgentGrid(RVO::RVOSimulator &sim, size_t side, float spacing)
+	{
+		std::vector<size_t> agentIDs;
+		unsigned int state = 1;
+
+		for (size_t x = 0; x < side; ++x) {
+			for (size_t y = 0; y < side; ++y) {
+				for (size_t z = 0; z < side; ++z) {
+					float jitter[3];
+
+					for (size_t k = 0; k < 3; ++k) {
+						state = state * 1664525u + 1013904223u;
+						jitter[k] = 2.0f * static_cast<float>(state >> 8) / 16777216.0f - 1.0f;
+					}
+
+					agentIDs.push_back(sim.addAgent(RVO::Vector3(x * spacing + jitter[0], y * spacing + jitter[1], z * spacing + jitter[2])));
+				}
+			}
+		}
+
+		return agentIDs;
+	}
+
+	/**
+	 * \brief   Returns the number of other agents within the neighbor distance of an agent.
+	 */
+	size_t countAgentsInRange(const RVO::RVOSimulator &sim, const std::vector<size_t> &agentIDs, size_t agentID)
+	{
+		size_t count = 0;
+
+		for (size_t i = 0; i < agentIDs.size(); ++i) {
+			if (agentIDs[i] != agentID && RVO::absSq(sim.getAgentPosition(agentIDs[i]) - sim.getAgentPosition(agentID)) < sim.getAgentNeighborDist(agentID) * sim.getAgentNeighborDist(agentID)) {
+				++count;
+			}
+		}
+
+		return count;
+	}
+
+	/**
+	 * \brief   Vector lengths and normalized vectors must stay within a relative error of 1e-6 of the exact results over a wide range of magnitudes, also with the fast reciprocal square root.
+	 */
+	bool testNormalizeWithinTolerance()
+	{
+		const double tolerance = 1.0e-6;
+		unsigned int state = 1;
+
+		for (int i = 0; i < 100000; ++i) {
+			float components[3];
+
+			for (size_t k = 0; k < 3; ++k) {
+				state = state * 1664525u + 1013904223u;
+				components[k] = 2.0f * static_cast<float>(state >> 8) / 16777216.0f - 1.0f;
+			}
+
+			/* Magnitudes from 1e-3 to 1e4. */
+			const float scale = std::pow(10.0f, static_cast<float>(i % 8) - 3.0f);
+			const RVO::Vector3 vector(components[0] * scale, components[1] * scale, components[2] * scale);
+			const double length = std::sqrt(static_cast<double>(vector.x()) * vector.x() + static_cast<double>(vector.y()) * vector.y() + static_cast<double>(vector.z()) * vector.z());
+
+			if (length == 0.0) {
+				continue;
+			}
+
+			if (std::fabs(RVO::abs(vector) - length) > tolerance * length) {
+				std::printf("abs of (%g, %g, %g) is %.9g, expected %.9g\n", vector.x(), vector.y(), vector.z(), RVO::abs(vector), length);
+				return false;
+			}
+
+			const RVO::Vector3 normal = RVO::normalize(vector);
+
+			for (size_t k = 0; k < 3; ++k) {
+				if (std::fabs(normal[k] - vector[k] / length) > tolerance) {
+					std::printf("normalize of (%g, %g, %g) is (%.9g, %.9g, %.9g), expected (%.9g, %.9g, %.9g)\n", vector.x(), vector.y(), vector.z(), normal.x(), normal.y(), normal.z(), vector.x() / length, vector.y() / length, vector.z() / length);
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * \brief   Agents solved every eighth step must count their neighbors of the latest search only, whichever pass searched them.
+	 */
+	bool testAdaptiveNeighborsUnderLOD()
+	{
+		for (int mode = 0; mode < 3; ++mode) {
+			RVO::RVOSimulator sim(0.125f, 15.0f, 64, 10.0f, 1.5f, 2.0f);
+			const std::vector<size_t> agentIDs = addAgentGrid(sim, 10, 13.0f);
+
+			sim.setAdaptiveNeighbors(true);
+			sim.setDualTreeNeighborSearch(mode == 0);
+			sim.setTimedPhases(mode == 1);
+			sim.setUrgencyScheduling(mode == 2);
+
+			for (size_t i = 0; i < agentIDs.size(); i += 2) {
+				sim.setAgentUpdateInterval(agentIDs[i], 8);
+			}
+
+			for (int step = 0; step < 400; ++step) {
+				sim.doStep();
+			}
+
+			for (size_t i = 0; i < agentIDs.size(); ++i) {
+				const size_t bound = static_cast<size_t>(std::ceil(countAgentsInRange(sim, agentIDs, agentIDs[i]) * 1.5f)) + 1;
+
+				if (sim.getAgentEffectiveMaxNeighbors(agentIDs[i]) > bound) {
+					std::printf("mode %d: agent %lu has %lu effective neighbors, expected at most %lu\n", mode, static_cast<unsigned long>(agentIDs[i]), static_cast<unsigned long>(sim.getAgentEffectiveMaxNeighbors(agentIDs[i])), static_cast<unsigned long>(bound));
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * \brief   Steps a contracting swarm with half of the agents solved every fourth step and returns the final positions and effective maximum neighbors.
+	 */
+	void runSwarmUnderLOD(bool dualTree, bool adaptive, std::vector<RVO::Vector3> &positions, std::vector<size_t> &effectiveMaxNeighbors)
+	{
+		RVO::RVOSimulator sim(0.125f, 15.0f, 32, 10.0f, 1.5f, 2.0f);
+		const std::vector<size_t> agentIDs = addAgentGrid(sim, 10, 9.0f);
+		const RVO::Vector3 center(40.5f, 40.5f, 40.5f);
+
+		sim.setDualTreeNeighborSearch(dualTree);
+		sim.setAdaptiveNeighbors(adaptive);
+
+		for (size_t i = 0; i < agentIDs.size(); i += 2) {
+			sim.setAgentUpdateInterval(agentIDs[i], 4);
+		}
+
+		for (int step = 0; step < 60; ++step) {
+			for (size_t i = 0; i < agentIDs.size(); ++i) {
+				sim.setAgentPrefVelocity(agentIDs[i], RVO::normalize(center - sim.getAgentPosition(agentIDs[i])) * 2.0f);
+			}
+
+			sim.doStep();
+		}
+
+		for (size_t i = 0; i < agentIDs.size(); ++i) {
+			positions.push_back(sim.getAgentPosition(agentIDs[i]));
+			effectiveMaxNeighbors.push_back(sim.getAgentEffectiveMaxNeighbors(agentIDs[i]));
+		}
+	}
+
+	/**
+	 * \brief   The dual-tree search must find the same neighbors, and count the same neighbors in range, as the per-agent search, also for agents skipped between solves.
+	 */
+	bool testDualTreeMatchesPerAgentUnderLOD()
+	{
+		for (int adaptive = 0; adaptive < 2; ++adaptive) {
+			std::vector<RVO::Vector3> perAgent;
+			std::vector<RVO::Vector3> dualTree;
+			std::vector<size_t> perAgentBudgets;
+			std::vector<size_t> dualTreeBudgets;
+
+			runSwarmUnderLOD(false, adaptive != 0, perAgent, perAgentBudgets);
+			runSwarmUnderLOD(true, adaptive != 0, dualTree, dualTreeBudgets);
+
+			for (size_t i = 0; i < perAgent.size(); ++i) {
+				if (perAgentBudgets[i] != dualTreeBudgets[i]) {
+					std::printf("adaptive %d: agent %lu has %lu effective neighbors per agent, %lu dual tree\n", adaptive, static_cast<unsigned long>(i), static_cast<unsigned long>(perAgentBudgets[i]), static_cast<unsigned long>(dualTreeBudgets[i]));
+					return false;
+				}
+
+				if (RVO::absSq(perAgent[i] - dualTree[i]) > 1.0e-8f) {
+					std::printf("adaptive %d: agent %lu at (%f, %f, %f) per agent, (%f, %f, %f) dual tree\n", adaptive, static_cast<unsigned long>(i), perAgent[i].x(), perAgent[i].y(), perAgent[i].z(), dualTree[i].x(), dualTree[i].y(), dualTree[i].z());
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * \brief   Steps a contracting swarm configured by a callback and returns the final positions.
+	 */
+	std::vector<RVO::Vector3> runSwarm(void (*configure)(RVO::RVOSimulator &, const std::vector<size_t> &))
+	{
+		RVO::RVOSimulator sim(0.125f, 15.0f, 32, 10.0f, 1.5f, 2.0f);
+		const std::vector<size_t> agentIDs = addAgentGrid(sim, 8, 6.0f);
+		const RVO::Vector3 center(21.0f, 21.0f, 21.0f);
+		std::vector<RVO::Vector3> positions;
+
+		configure(sim, agentIDs);
+
+		for (int step = 0; step < 80; ++step) {
+			for (size_t i = 0; i < agentIDs.size(); ++i) {
+				sim.setAgentPrefVelocity(agentIDs[i], RVO::normalize(center - sim.getAgentPosition(agentIDs[i])) * 2.0f);
+			}
+
+			sim.doStep();
+		}
+
+		for (size_t i = 0; i < agentIDs.size(); ++i) {
+			positions.push_back(sim.getAgentPosition(agentIDs[i]));
+		}
+
+		return positions;
+	}
+
+	/**
+	 * \brief   Returns whether two runs ended with the same positions, and prints the first mismatch.
+	 */
+	bool samePositions(const char *what, const std::vector<RVO::Vector3> &expected, const std::vector<RVO::Vector3> &actual)
+	{
+		for (size_t i = 0; i < expected.size(); ++i) {
+			if (RVO::absSq(expected[i] - actual[i]) > 1.0e-8f) {
+				std::printf("%s: agent %lu at (%f, %f, %f), expected (%f, %f, %f)\n", what, static_cast<unsigned long>(i), actual[i].x(), actual[i].y(), actual[i].z(), expected[i].x(), expected[i].y(), expected[i].z());
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void configureDefault(RVO::RVOSimulator &, const std::vector<size_t> &)
+	{
+	}
+
+	void configureUrgency(RVO::RVOSimulator &sim, const std::vector<size_t> &)
+	{
+		sim.setUrgencyScheduling(true);
+	}
+
+	/**
+	 * \brief   Without a time budget or a maximum number of solved agents, urgency scheduling must only reorder the solves.
+	 */
+	bool testUnboundedUrgencyMatchesDefault()
+	{
+		return samePositions("urgency", runSwarm(configureDefault), runSwarm(configureUrgency));
+	}
+
+	void configureMixedStepMultiples(RVO::RVOSimulator &sim, const std::vector<size_t> &agentIDs)
+	{
+		for (size_t i = 0; i < agentIDs.size(); i += 3) {
+			sim.setAgentStepMultiple(agentIDs[i], 2);
+		}
+	}
+
+	void configureSharedMixedStepMultiples(RVO::RVOSimulator &sim, const std::vector<size_t> &agentIDs)
+	{
+		sim.setSharedORCAPlanes(true);
+		configureMixedStepMultiples(sim, agentIDs);
+	}
+
+	/**
+	 * \brief   Shared ORCA planes must give the same positions as planes computed per agent, also between agents with different solve intervals.
+	 */
+	bool testSharedPlanesMatchUnsharedUnderMixedIntervals()
+	{
+		return samePositions("shared planes", runSwarm(configureMixedStepMultiples), runSwarm(configureSharedMixedStepMultiples));
+	}
+
+	/**
+	 * \brief   A moving passive agent must rebuild the neighbor candidate lists only once it has moved half of the skin, like any other agent.
+	 */
+	bool testPassiveAgentSkinRebuilds()
+	{
+		for (int dualTree = 0; dualTree < 2; ++dualTree) {
+			RVO::RVOSimulator sim(0.125f, 15.0f, 10, 10.0f, 1.5f, 2.0f);
+			const std::vector<size_t> agentIDs = addAgentGrid(sim, 4, 6.0f);
+			const RVO::Vector3 velocity(1.0f, 0.0f, 0.0f);
+			const float neighborSkin = 2.0f;
+			const int numSteps = 64;
+			int rebuilds = 0;
+
+			sim.setNeighborSkin(neighborSkin);
+			sim.setDualTreeNeighborSearch(dualTree != 0);
+			sim.setTimedPhases(true);
+			sim.setAgentPassive(agentIDs[0], true);
+
+			for (int step = 0; step < numSteps; ++step) {
+				sim.setAgentVelocity(agentIDs[0], velocity);
+				sim.doStep();
+
+				if (sim.getPhaseTimings().buildTree > 0.0f) {
+					++rebuilds;
+				}
+			}
+
+			/* The first step builds the lists, then every half skin of displacement rebuilds them. */
+			const int maxRebuilds = 2 + static_cast<int>(numSteps * sim.getTimeStep() * RVO::abs(velocity) / (0.5f * neighborSkin));
+
+			if (rebuilds > maxRebuilds) {
+				std::printf("dual tree %d: %d rebuilds in %d steps, expected at most %d\n", dualTree, rebuilds, numSteps, maxRebuilds);
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * \brief   Archetypes acquired for parameter sets that go out of use must be recycled, while archetypes added explicitly are kept.
+	 */
+	bool testArchetypesRecycled()
+	{
+		RVO::RVOSimulator sim(0.125f, 15.0f, 10, 10.0f, 1.5f, 2.0f);
+		const size_t pinnedNo = sim.addArchetype(RVO::AgentArchetype(15.0f, 10, 10.0f, 0.5f, 2.0f));
+		const size_t agentID = sim.addAgent(RVO::Vector3(), pinnedNo);
+		const size_t numArchetypes = sim.getNumArchetypes();
+
+		for (int i = 0; i < 100; ++i) {
+			/* Each retune acquires a new parameter set and releases the previous one. */
+			sim.setAgentArchetype(agentID, sim.acquireArchetype(RVO::AgentArchetype(15.0f, 10, 10.0f, 1.0f + 0.01f * i, 2.0f)));
+		}
+
+		if (sim.getNumArchetypes() > numArchetypes + 2) {
+			std::printf("%lu archetypes after retuning, expected at most %lu\n", static_cast<unsigned long>(sim.getNumArchetypes()), static_cast<unsigned long>(numArchetypes + 2));
+			return false;
+		}
+
+		sim.setAgentArchetype(agentID, sim.acquireArchetype(RVO::AgentArchetype(15.0f, 10, 10.0f, 1.0f, 2.0f)));
+
+		if (sim.findArchetype(RVO::AgentArchetype(15.0f, 10, 10.0f, 1.0f + 0.01f * 99, 2.0f)) != RVO::RVO_ERROR) {
+			std::printf("released archetype still found\n");
+			return false;
+		}
+
+		if (sim.findArchetype(RVO::AgentArchetype(15.0f, 10, 10.0f, 0.5f, 2.0f)) != pinnedNo) {
+			std::printf("added archetype not kept while unreferenced\n");
+			return false;
+		}
+
+		return true;
+	}
+
+	struct Test {
+		const char *name;
+		bool (*run)();
+	};
+
+	const Test Tests[] = {
+		{ "AdaptiveNeighborsUnderLOD", testAdaptiveNeighborsUnderLOD },
+		{ "ArchetypesRecycled", testArchetypesRecycled },
+		{ "DualTreeMatchesPerAgentUnderLOD", testDualTreeMatchesPerAgentUnderLOD },
+		{ "NormalizeWithinTolerance", testNormalizeWithinTolerance },
+		{ "PassiveAgentSkinRebuilds", testPassiveAgentSkinRebuilds },
+		{ "SharedPlanesMatchUnsharedUnderMixedIntervals", testSharedPlanesMatchUnsharedUnderMixedIntervals },
+		{ "UnboundedUrgencyMatchesDefault", testUnboundedUrgencyMatchesDefault }
+	};
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		std::fprintf(stderr, "Usage: RVOCoreTests TEST\n");
+		return 2;
+	}
+
+	for (size_t i = 0; i < sizeof(Tests) / sizeof(Tests[0]); ++i) {
+		if (std::strcmp(argv[1], Tests[i].name) == 0) {
+			return Tests[i].run() ? 0 : 1;
+		}
+	}
+
+	std::fprintf(stderr, "Unknown test %s\n", argv[1]);
+	return 2;
+}